@@ -0,0 +1,543 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Process address spaces. Each address space is described by a list of
+ * regions that the process is allowed to touch and a 2 level software page
+ * table recording which frames are currently mapped. Pages are only
+ * allocated when the process faults on them (see vm.c).
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cspace/cspace.h>
+
+#include "addrspace.h"
+#include "cont.h"
+#include "frametable.h"
+#include "imagecache.h"
+#include "mapping.h"
+#include "objcache.h"
+#include "pager.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+#define PAGESIZE              (1 << (seL4_PageBits))
+#define PAGEMASK              ((PAGESIZE) - 1)
+#define PAGE_ALIGN(addr)      ((addr) & ~(PAGEMASK))
+#define PAGE_ALIGN_UP(addr)   PAGE_ALIGN((addr) + PAGEMASK)
+
+#define MIN(a,b)              (((a)<(b))?(a):(b))
+#define MAX(a,b)              (((a)>(b))?(a):(b))
+
+#define AS_L1_ENTRIES         (1 << AS_L1_BITS)
+#define AS_L2_ENTRIES         (1 << AS_L2_BITS)
+
+addrspace_t*
+as_create(void){
+    addrspace_t* as;
+
+    as = malloc(sizeof(*as));
+    if(as == NULL){
+        return NULL;
+    }
+    memset(as, 0, sizeof(*as));
+
+    as->pagetable = calloc(AS_L1_ENTRIES, sizeof(pte_t*));
+    if(as->pagetable == NULL){
+        free(as);
+        return NULL;
+    }
+
+    as->vroot = objcache_alloc(OBJCACHE_PD, &as->vroot_addr);
+    if(as->vroot == CSPACE_NULL){
+        free(as->pagetable);
+        free(as);
+        return NULL;
+    }
+
+    return as;
+}
+
+/*
+ * Whether pagefile I/O or a fault in progress still refers to an
+ * address space
+ */
+static int
+_as_busy(addrspace_t* as){
+    int i, j;
+
+    if(as->faults > 0){
+        return 1;
+    }
+    for(i = 0; i < AS_L1_ENTRIES; i++){
+        pte_t* l2 = as->pagetable[i];
+        if(l2 == NULL){
+            continue;
+        }
+        for(j = 0; j < AS_L2_ENTRIES; j++){
+            if(l2[j].busy){
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Frees the address space once nothing refers to it. The pager wakes us
+ * whenever it finishes with a page, and the faults on the address space
+ * complete from the pager too. Completions may start more I/O on the
+ * address space, so check again each time.
+ */
+static int
+_as_destroy_step(struct cont* c){
+    addrspace_t* as = (addrspace_t*)c;
+    int i, j;
+
+    if(_as_busy(as)){
+        return CONT_WAIT;
+    }
+
+    /* Release every resident page */
+    for(i = 0; i < AS_L1_ENTRIES; i++){
+        pte_t* l2 = as->pagetable[i];
+        if(l2 == NULL){
+            continue;
+        }
+        for(j = 0; j < AS_L2_ENTRIES; j++){
+            if(l2[j].cap != seL4_CapNull){
+                if(l2[j].mapped){
+                    seL4_ARM_Page_Unmap(l2[j].cap);
+                }
+                cspace_delete_cap(cur_cspace, l2[j].cap);
+                if(l2[j].cow){
+                    frame_unshare(l2[j].frame, &l2[j]);
+                }
+                if(!l2[j].shared && !l2[j].device){
+                    frame_free(l2[j].frame);
+                }
+            }else if(l2[j].swapped){
+                pager_free_slot(l2[j].frame);
+            }
+        }
+        free(l2);
+    }
+    free(as->pagetable);
+
+    /* Release the kernel page tables */
+    while(as->kernel_pts != NULL){
+        struct kernel_pt* pt = as->kernel_pts;
+        as->kernel_pts = pt->next;
+        objcache_free(OBJCACHE_PT, pt->cap, pt->addr);
+        free(pt);
+    }
+
+    objcache_free(OBJCACHE_PD, as->vroot, as->vroot_addr);
+
+    while(as->regions != NULL){
+        region_t* r = as->regions;
+        as->regions = r->next;
+        if(r->shared != NULL){
+            image_segment_put(r->shared);
+        }
+        free(r);
+    }
+    free(as);
+    return CONT_DONE;
+}
+
+void
+as_destroy(addrspace_t* as){
+    cont_start(&as->destroy, _as_destroy_step, SOS_PRIO_MIN);
+}
+
+region_t*
+as_define_region(addrspace_t* as, seL4_Word vbase, seL4_Word size,
+                 seL4_CapRights rights){
+    region_t* r;
+    seL4_Word vend;
+
+    assert((vbase & PAGEMASK) == 0);
+    vend = PAGE_ALIGN_UP(vbase + size);
+    if(vend <= vbase){
+        return NULL;
+    }
+
+    for(r = as->regions; r != NULL; r = r->next){
+        if(vbase < r->vend && r->vbase < vend){
+            dprintf(0, "Region 0x%08x-0x%08x overlaps 0x%08x-0x%08x\n",
+                    vbase, vend, r->vbase, r->vend);
+            return NULL;
+        }
+    }
+
+    r = malloc(sizeof(*r));
+    if(r == NULL){
+        return NULL;
+    }
+    r->vbase = vbase;
+    r->vend = vend;
+    r->rights = rights;
+    r->data = NULL;
+    r->data_vbase = 0;
+    r->data_size = 0;
+    r->shared = NULL;
+    r->next = as->regions;
+    as->regions = r;
+    return r;
+}
+
+/*
+ * Intersects the page at vpage with the initialised part of the region
+ * @return 0 if they do not overlap
+ */
+static int
+_as_page_data(region_t* region, seL4_Word vpage,
+              seL4_Word* start, seL4_Word* end){
+    if(region->data == NULL){
+        return 0;
+    }
+    *start = MAX(vpage, region->data_vbase);
+    *end = MIN(vpage + PAGESIZE, region->data_vbase + region->data_size);
+    return *start < *end;
+}
+
+int
+as_page_is_zero(region_t* region, seL4_Word vaddr){
+    seL4_Word start, end;
+    return !_as_page_data(region, PAGE_ALIGN(vaddr), &start, &end);
+}
+
+void
+as_fill_page(region_t* region, seL4_Word vaddr, int frame){
+    seL4_Word vpage = PAGE_ALIGN(vaddr);
+    seL4_Word start, end;
+    char* page;
+
+    if(!_as_page_data(region, vpage, &start, &end)){
+        return;
+    }
+
+    page = frame_vaddr(frame);
+    memcpy(page + (start - vpage), region->data + (start - region->data_vbase),
+           end - start);
+    /* The contents may be executed by the process */
+    frame_sync_icache(frame);
+}
+
+region_t*
+as_find_region(addrspace_t* as, seL4_Word vaddr){
+    region_t* r;
+    for(r = as->regions; r != NULL; r = r->next){
+        if(vaddr >= r->vbase && vaddr < r->vend){
+            return r;
+        }
+    }
+    return NULL;
+}
+
+pte_t*
+as_lookup_pte(addrspace_t* as, seL4_Word vaddr, int create){
+    pte_t** l1e = &as->pagetable[AS_L1_INDEX(vaddr)];
+
+    if(*l1e == NULL){
+        if(!create){
+            return NULL;
+        }
+        *l1e = calloc(AS_L2_ENTRIES, sizeof(pte_t));
+        if(*l1e == NULL){
+            return NULL;
+        }
+    }
+    return &(*l1e)[AS_L2_INDEX(vaddr)];
+}
+
+/*
+ * A page whose pagefile copy is still valid is mapped read only, so that
+ * the first write faults and the copy can be dropped
+ */
+static seL4_CapRights
+_as_page_rights(int frame, seL4_CapRights rights){
+    if(frame_slot(frame) >= 0){
+        return rights & ~seL4_CanWrite;
+    }
+    return rights;
+}
+
+/* How a page table entry holds its frame */
+enum as_map_type {
+    AS_MAP_PRIVATE,
+    AS_MAP_SHARED,
+    AS_MAP_COW
+};
+
+/*
+ * Maps cap at vaddr, recording any page table the kernel needed
+ * @return the page table entry for vaddr, or NULL on failure
+ */
+static pte_t*
+_as_map_cap(addrspace_t* as, seL4_Word vaddr, seL4_CPtr cap,
+            seL4_CapRights rights, seL4_ARM_VMAttributes attr){
+    seL4_ARM_PageTable pt_cap;
+    seL4_Word pt_addr;
+    pte_t* pte;
+    int err;
+
+    pte = as_lookup_pte(as, vaddr, 1);
+    if(pte == NULL){
+        return NULL;
+    }
+    assert(pte->cap == seL4_CapNull);
+
+    err = map_page_pt(cap, as->vroot, vaddr, rights, attr, &pt_cap, &pt_addr);
+    if(pt_cap != seL4_CapNull){
+        struct kernel_pt* pt = malloc(sizeof(*pt));
+        conditional_panic(pt == NULL, "Out of memory recording a page table");
+        pt->cap = pt_cap;
+        pt->addr = pt_addr;
+        pt->next = as->kernel_pts;
+        as->kernel_pts = pt;
+    }
+    if(err){
+        return NULL;
+    }
+
+    pte->cap = cap;
+    pte->mapped = 1;
+    pte->swapped = 0;
+    pte->shared = 0;
+    pte->cow = 0;
+    pte->device = 0;
+    return pte;
+}
+
+static int
+_as_map(addrspace_t* as, seL4_Word vaddr, int frame,
+        seL4_CapRights rights, enum as_map_type type){
+    seL4_CPtr cap;
+    pte_t* pte;
+
+    /* Shared frames are mapped through a read only cap */
+    cap = cspace_copy_cap(cur_cspace, cur_cspace, frame_cap(frame),
+                          type == AS_MAP_SHARED ? seL4_CanRead : seL4_AllRights);
+    if(cap == CSPACE_NULL){
+        return !0;
+    }
+    if(type == AS_MAP_PRIVATE){
+        rights = _as_page_rights(frame, rights);
+    }
+    pte = _as_map_cap(as, PAGE_ALIGN(vaddr), cap, rights,
+                      seL4_ARM_Default_VMAttributes);
+    if(pte == NULL){
+        cspace_delete_cap(cur_cspace, cap);
+        return !0;
+    }
+
+    pte->frame = frame;
+    pte->shared = (type == AS_MAP_SHARED);
+    pte->cow = (type == AS_MAP_COW);
+    if(type == AS_MAP_PRIVATE){
+        frame_set_owner(frame, pte);
+    }
+    return 0;
+}
+
+int
+as_map_frame(addrspace_t* as, seL4_Word vaddr, int frame,
+             seL4_CapRights rights){
+    return _as_map(as, vaddr, frame, rights, AS_MAP_PRIVATE);
+}
+
+int
+as_map_shared_frame(addrspace_t* as, seL4_Word vaddr, int frame){
+    return _as_map(as, vaddr, frame, seL4_CanRead, AS_MAP_SHARED);
+}
+
+int
+as_map_zero(addrspace_t* as, seL4_Word vaddr){
+    int zero = frame_get_zero();
+    int err;
+
+    frame_ref(zero);
+    err = _as_map(as, vaddr, zero, seL4_CanRead, AS_MAP_COW);
+    if(err){
+        frame_free(zero);
+    }
+    return err;
+}
+
+int
+as_map_device(addrspace_t* as, seL4_Word vaddr, seL4_CPtr cap){
+    seL4_CPtr copy;
+    pte_t* pte;
+
+    copy = cspace_copy_cap(cur_cspace, cur_cspace, cap, seL4_CanRead);
+    if(copy == CSPACE_NULL){
+        return !0;
+    }
+    /* Device registers must not be cached */
+    pte = _as_map_cap(as, PAGE_ALIGN(vaddr), copy, seL4_CanRead, 0);
+    if(pte == NULL){
+        cspace_delete_cap(cur_cspace, copy);
+        return !0;
+    }
+    pte->frame = 0;
+    pte->device = 1;
+    return 0;
+}
+
+int
+as_break_cow(addrspace_t* as, seL4_Word vaddr, pte_t* pte, int frame,
+             seL4_CapRights rights){
+    int old_frame = pte->frame;
+
+    assert(pte->cow && pte->cap != seL4_CapNull);
+
+    if(pte->mapped){
+        seL4_ARM_Page_Unmap(pte->cap);
+        pte->mapped = 0;
+    }
+
+    if(frame_refcount(old_frame) == 1){
+        /* Everyone else has let go, so just take the frame over. We
+         * already own it; any pagefile copy is about to go stale */
+        if(frame != FRAME_INVALID){
+            frame_free(frame);
+        }
+        pte->cow = 0;
+        frame_mark_dirty(old_frame);
+        return as_remap_page(as, vaddr, pte, rights);
+    }
+
+    assert(frame != FRAME_INVALID);
+    if(old_frame != frame_get_zero()){
+        /* New frames are already zero filled */
+        memcpy(frame_vaddr(frame), frame_vaddr(old_frame), PAGESIZE);
+    }
+
+    cspace_delete_cap(cur_cspace, pte->cap);
+    pte->cap = seL4_CapNull;
+    pte->cow = 0;
+    frame_unshare(old_frame, pte);
+    frame_free(old_frame);
+    return as_map_frame(as, vaddr, frame, rights);
+}
+
+/*
+ * Shares a single page of src with dst
+ */
+static int
+_as_clone_page(addrspace_t* dst, addrspace_t* src, region_t* region,
+               seL4_Word vaddr, pte_t* pte){
+    pte_t* dst_pte;
+    int err;
+
+    if(pte->busy || (pte->cap == seL4_CapNull && pte->swapped)){
+        /* The caller should have brought it in with vm_page_in_all */
+        return !0;
+    }
+    if(pte->cap == seL4_CapNull){
+        return 0;
+    }
+
+    if(pte->shared){
+        return as_map_shared_frame(dst, vaddr, pte->frame);
+    }
+    if(pte->device){
+        return as_map_device(dst, vaddr, pte->cap);
+    }
+    if(frame_is_pinned(pte->frame)){
+        /* e.g. the IPC buffer, which the caller must provide itself */
+        return 0;
+    }
+
+    /* The frame table must know every sharer to page the frame out */
+    dst_pte = as_lookup_pte(dst, vaddr, 1);
+    if(dst_pte == NULL || frame_share(pte->frame, dst_pte)){
+        return !0;
+    }
+    if(!pte->cow){
+        /* Write protect the source's copy. It is remapped read only on
+         * the next fault */
+        if(pte->mapped){
+            seL4_ARM_Page_Unmap(pte->cap);
+            pte->mapped = 0;
+        }
+        pte->cow = 1;
+    }
+    frame_ref(pte->frame);
+    err = _as_map(dst, vaddr, pte->frame, seL4_CanRead, AS_MAP_COW);
+    if(err){
+        frame_unshare(pte->frame, dst_pte);
+        frame_free(pte->frame);
+    }
+    return err;
+}
+
+int
+as_clone(addrspace_t* dst, addrspace_t* src){
+    region_t* r;
+    int err;
+
+    assert(dst->regions == NULL);
+
+    for(r = src->regions; r != NULL; r = r->next){
+        region_t* nr;
+        seL4_Word vaddr;
+
+        nr = as_define_region(dst, r->vbase, r->vend - r->vbase, r->rights);
+        if(nr == NULL){
+            return !0;
+        }
+        nr->data = r->data;
+        nr->data_vbase = r->data_vbase;
+        nr->data_size = r->data_size;
+        if(r->shared != NULL){
+            nr->shared = r->shared;
+            image_segment_ref(nr->shared);
+        }
+
+        for(vaddr = r->vbase; vaddr < r->vend; vaddr += PAGESIZE){
+            pte_t* pte = as_lookup_pte(src, vaddr, 0);
+            if(pte == NULL){
+                /* Skip the rest of the unused second level table */
+                vaddr |= (1 << (seL4_PageBits + AS_L2_BITS)) - PAGESIZE;
+                continue;
+            }
+            err = _as_clone_page(dst, src, r, vaddr, pte);
+            if(err){
+                return err;
+            }
+        }
+    }
+    return 0;
+}
+
+int
+as_remap_page(addrspace_t* as, seL4_Word vaddr, pte_t* pte,
+              seL4_CapRights rights){
+    int err;
+
+    assert(pte->cap != seL4_CapNull && !pte->mapped);
+    if(!pte->shared && !pte->device){
+        rights = _as_page_rights(pte->frame, rights);
+    }
+    err = seL4_ARM_Page_Map(pte->cap, as->vroot, PAGE_ALIGN(vaddr), rights,
+                            seL4_ARM_Default_VMAttributes);
+    if(err){
+        return !0;
+    }
+    pte->mapped = 1;
+    return 0;
+}
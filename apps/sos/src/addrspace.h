@@ -0,0 +1,202 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _ADDRSPACE_H_
+#define _ADDRSPACE_H_
+
+#include <sel4/sel4.h>
+
+#include "cont.h"
+
+/* Software page table geometry, mirroring the ARM 2 level layout */
+#define AS_L1_BITS          (10)
+#define AS_L2_BITS          (10)
+#define AS_L1_INDEX(v)      ((v) >> (seL4_PageBits + AS_L2_BITS))
+#define AS_L2_INDEX(v)      (((v) >> seL4_PageBits) & ((1 << AS_L2_BITS) - 1))
+
+/* A contiguous range of virtual memory [vbase, vend). Pages are zero
+ * filled except for [data_vbase, data_vbase + data_size), which is
+ * initialised from data (e.g. a segment of an executable in the cpio
+ * archive) when first touched. */
+typedef struct region {
+    seL4_Word vbase;
+    seL4_Word vend;
+    seL4_CapRights rights;
+    const char* data;
+    seL4_Word data_vbase;
+    seL4_Word data_size;
+    struct image_segment* shared;   /* frames shared with other processes */
+    struct region* next;
+} region_t;
+
+/* A page table entry. The page is resident iff cap != seL4_CapNull.
+ * A resident page may be temporarily unmapped by the frame table to
+ * sample its referenced bit; the next fault on it simply remaps it.
+ * Faults on a busy page wait until its pagefile I/O completes.
+ * Shared pages map a frame owned by the image cache rather than by
+ * this entry, and are never paged out. Copy on write pages share a
+ * frame with other address spaces and are mapped read only until the
+ * process writes to them. */
+typedef struct pte {
+    seL4_CPtr cap;              /* SOS's copy of the frame cap used for the mapping */
+    unsigned int frame   : 20;  /* frame table index while resident,
+                                 * pagefile slot while swapped */
+    unsigned int mapped  : 1;   /* present in the hardware page table */
+    unsigned int swapped : 1;   /* contents are held in the pagefile */
+    unsigned int busy    : 1;   /* pagefile I/O in progress */
+    unsigned int shared  : 1;   /* frame belongs to the image cache */
+    unsigned int cow     : 1;   /* frame may be shared copy on write */
+    unsigned int device  : 1;   /* device memory, not in the frame table */
+} pte_t;
+
+/* Page tables created in the kernel on behalf of this address space */
+struct kernel_pt {
+    seL4_ARM_PageTable cap;
+    seL4_Word addr;
+    struct kernel_pt* next;
+};
+
+typedef struct addrspace {
+    struct cont destroy;        /* frees it once nothing refers to it */
+    seL4_ARM_PageDirectory vroot;
+    seL4_Word vroot_addr;
+    region_t* regions;
+    pte_t** pagetable;
+    struct kernel_pt* kernel_pts;
+    int faults;                 /* faults on it waiting for I/O or a frame */
+} addrspace_t;
+
+/**
+ * Creates an empty address space, including a new page directory
+ * @return the new address space or NULL if out of memory
+ */
+addrspace_t* as_create(void);
+
+/**
+ * Destroys an address space. All frames mapped into the address space
+ * are returned to the frame table. If pagefile I/O on its pages or
+ * faults waiting on it are still in flight, it is freed by a
+ * continuation once they have completed instead.
+ * @param as the address space to destroy, which must not be used again
+ */
+void as_destroy(addrspace_t* as);
+
+/**
+ * Defines a new zero filled region of virtual memory in which the
+ * process may fault.
+ * @param as the address space to modify
+ * @param vbase the page aligned base address of the region
+ * @param size the size of the region in bytes, rounded up to a page
+ * @param rights the rights with which pages in the region will be mapped
+ * @return the new region, or NULL if the region overlaps an existing
+ *         region or we are out of memory
+ */
+region_t* as_define_region(addrspace_t* as, seL4_Word vbase, seL4_Word size,
+                           seL4_CapRights rights);
+
+/**
+ * Initialises a newly allocated frame with the region's contents for
+ * the page at vaddr
+ * @param region the region containing vaddr
+ * @param vaddr an address within the page to fill
+ * @param frame a zero filled frame
+ */
+void as_fill_page(region_t* region, seL4_Word vaddr, int frame);
+
+/**
+ * Returns non zero if the page at vaddr starts out zero filled, i.e. it
+ * does not overlap the region's backing data
+ */
+int as_page_is_zero(region_t* region, seL4_Word vaddr);
+
+/**
+ * Finds the region containing a virtual address
+ * @return the region or NULL if the address is not in any region
+ */
+region_t* as_find_region(addrspace_t* as, seL4_Word vaddr);
+
+/**
+ * Finds the page table entry for a virtual address
+ * @param create if set, allocate a second level table if required
+ * @return the entry, or NULL if no second level table exists (or it could
+ *         not be created)
+ */
+pte_t* as_lookup_pte(addrspace_t* as, seL4_Word vaddr, int create);
+
+/**
+ * Maps a frame into the address space. A copy of the frame cap is used
+ * for the mapping and recorded in the page table entry, which becomes the
+ * frame's owner in the frame table.
+ * @param as the address space to map into
+ * @param vaddr the address at which to map the frame
+ * @param frame the frame table index of the frame to map
+ * @param rights the rights for the mapping
+ * @return 0 on success
+ */
+int as_map_frame(addrspace_t* as, seL4_Word vaddr, int frame,
+                 seL4_CapRights rights);
+
+/**
+ * Maps a frame owned by SOS, such as one held by the image cache, into
+ * the address space. The mapping is made through a read only copy of the
+ * frame cap, and the frame does not become owned by the page table entry.
+ * @return 0 on success
+ */
+int as_map_shared_frame(addrspace_t* as, seL4_Word vaddr, int frame);
+
+/**
+ * Maps the shared zero frame read only in place of an untouched page.
+ * The page becomes copy on write, so the first write to it allocates a
+ * private frame.
+ * @return 0 on success
+ */
+int as_map_zero(addrspace_t* as, seL4_Word vaddr);
+
+/**
+ * Maps a page of device memory read only into the address space, through
+ * a copy of cap. The page is never paged out, and is shared with any
+ * clone of the address space.
+ * @param cap SOS's cap to the device frame
+ * @return 0 on success
+ */
+int as_map_device(addrspace_t* as, seL4_Word vaddr, seL4_CPtr cap);
+
+/**
+ * Gives a private copy of a copy on write page to the address space
+ * @param pte the resident copy on write entry for vaddr
+ * @param frame a new frame to copy the page into, or FRAME_INVALID if
+ *        the page is no longer shared. The frame is freed if it turns
+ *        out not to be needed.
+ * @param rights the rights of the region containing the page
+ * @return 0 on success
+ */
+int as_break_cow(addrspace_t* as, seL4_Word vaddr, pte_t* pte, int frame,
+                 seL4_CapRights rights);
+
+/**
+ * Copies the regions and pages of one address space into another, empty
+ * one. Writable pages are shared copy on write. Pinned pages are not
+ * copied.
+ * @pre every page of src must be resident, see vm_page_in_all
+ * @param dst the new address space
+ * @param src the address space to copy. It must not be running.
+ * @return 0 on success
+ */
+int as_clone(addrspace_t* dst, addrspace_t* src);
+
+/**
+ * Restores the hardware mapping of a resident page that the frame table
+ * unmapped to track references.
+ * @return 0 on success
+ */
+int as_remap_page(addrspace_t* as, seL4_Word vaddr, pte_t* pte,
+                  seL4_CapRights rights);
+
+#endif /* _ADDRSPACE_H_ */
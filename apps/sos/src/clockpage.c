@@ -0,0 +1,163 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Time stamps without a system call. GPT1 counts microseconds and every
+ * process can read its registers, along with a page of calibration that
+ * SOS updates only when the counter wraps, about every 71 minutes.
+ *
+ * The first output compare channel also gives SOS a periodic tick, so
+ * that time based work such as NFS retransmission happens even while
+ * every process is blocked.
+ */
+#include <assert.h>
+
+#include <cspace/cspace.h>
+#include <platsupport/plat/timer.h>
+#include <sos_syscall.h>
+#include <utils/util.h>
+
+#include "clockpage.h"
+#include "frametable.h"
+#include "mapping.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+#define PAGESIZE            (1 << (seL4_PageBits))
+
+/* Divide the peripheral clock down to one tick per microsecond */
+#define CLOCK_PRESCALER     (IPG_FREQ - 1)
+
+/* Microseconds between ticks */
+#define CLOCK_TICK_US       (100 * 1000)
+
+/* GPT registers read by processes */
+#define GPT_SR_OFFSET       (0x08)
+#define GPT_CNT_OFFSET      (0x24)
+#define GPT_SR_ROV          BIT(5)
+
+/* and those used for the tick */
+#define GPT_IR_OFFSET       (0x0C)
+#define GPT_OCR1_OFFSET     (0x10)
+#define GPT_SR_OF1          BIT(0)
+#define GPT_IR_OF1IE        BIT(0)
+
+#define GPT_REG(offset)     (*(volatile uint32_t*)(_regs + (offset)))
+
+static pstimer_t* _timer;
+static seL4_IRQHandler _irq_cap;
+static seL4_ARM_Page _counter_cap;
+static volatile char* _regs;
+static int _clock_frame = FRAME_INVALID;
+static struct sos_clock* _clock;
+
+void
+clock_page_init(seL4_CPtr interrupt_ep){
+    gpt_config_t config;
+    char* regs;
+    int err;
+
+    regs = map_device_page((void*)GPT1_DEVICE_PADDR, &_counter_cap);
+    _regs = regs;
+    config.vaddr = regs;
+    config.prescaler = CLOCK_PRESCALER;
+    _timer = gpt_get_timer(&config);
+    conditional_panic(_timer == NULL, "Failed to initialise GPT1");
+
+    _irq_cap = cspace_irq_control_get_cap(cur_cspace, seL4_CapIRQControl,
+                                          GPT1_INTERRUPT);
+    conditional_panic(!_irq_cap, "Failed to acquire the GPT1 IRQ");
+    err = seL4_IRQHandler_SetEndpoint(_irq_cap, interrupt_ep);
+    conditional_panic(err, "Failed to set the GPT1 IRQ endpoint");
+    err = seL4_IRQHandler_Ack(_irq_cap);
+    conditional_panic(err, "Failed to acknowledge the GPT1 IRQ");
+
+    /* Unowned frames are never paged out */
+    _clock_frame = frame_alloc();
+    conditional_panic(_clock_frame == FRAME_INVALID,
+                      "No memory for the clock page");
+    frame_pin(_clock_frame);
+    _clock = frame_vaddr(_clock_frame);
+    _clock->freq = IPG_FREQ / (CLOCK_PRESCALER + 1);
+    _clock->counter = GPT_CNT_OFFSET;
+    _clock->status = GPT_SR_OFFSET;
+    _clock->status_wrap = GPT_SR_ROV;
+
+    timer_start(_timer);
+    _clock->base = *(volatile uint32_t*)(regs + GPT_CNT_OFFSET);
+
+    /* Start ticking */
+    GPT_REG(GPT_OCR1_OFFSET) = _clock->base + CLOCK_TICK_US;
+    GPT_REG(GPT_IR_OFFSET) |= GPT_IR_OF1IE;
+}
+
+uint64_t
+clock_page_time(void){
+    uint32_t count, status;
+    uint64_t ticks;
+
+    if(_clock == NULL){
+        return 0;
+    }
+    /* Nothing else updates the page while SOS is running */
+    count = *(volatile uint32_t*)(_regs + GPT_CNT_OFFSET);
+    status = *(volatile uint32_t*)(_regs + GPT_SR_OFFSET);
+    ticks = ((uint64_t)_clock->epoch << 32) + count;
+    if((status & GPT_SR_ROV) && count < (1u << 31)){
+        ticks += (uint64_t)1 << 32;
+    }
+    return (ticks - _clock->base) / _clock->freq;
+}
+
+void
+clock_page_irq(void){
+    uint32_t status;
+    int err;
+
+    /* Status bits are cleared by writing them back */
+    status = GPT_REG(GPT_SR_OFFSET);
+    if(status & GPT_SR_OF1){
+        uint32_t next = GPT_REG(GPT_OCR1_OFFSET) + CLOCK_TICK_US;
+        /* Count from the last tick so they don't drift, unless we have
+         * fallen so far behind that the counter has passed the next one */
+        if((int32_t)(next - GPT_REG(GPT_CNT_OFFSET)) <= 0){
+            next = GPT_REG(GPT_CNT_OFFSET) + CLOCK_TICK_US;
+        }
+        GPT_REG(GPT_OCR1_OFFSET) = next;
+        GPT_REG(GPT_SR_OFFSET) = GPT_SR_OF1;
+    }
+    if(status & GPT_SR_ROV){
+        /* Readers retry while seq is odd or changes under them */
+        _clock->seq++;
+        __sync_synchronize();
+        _clock->epoch++;
+        GPT_REG(GPT_SR_OFFSET) = GPT_SR_ROV;
+        __sync_synchronize();
+        _clock->seq++;
+    }
+
+    err = seL4_IRQHandler_Ack(_irq_cap);
+    assert(!err);
+}
+
+int
+clock_page_map(process_t* proc){
+    assert(_clock != NULL);
+    if(as_define_region(proc->as, SOS_CLOCK_PAGE, 2 * PAGESIZE,
+                        seL4_CanRead) == NULL){
+        return !0;
+    }
+    if(as_map_shared_frame(proc->as, SOS_CLOCK_PAGE, _clock_frame)){
+        return !0;
+    }
+    return as_map_device(proc->as, SOS_CLOCK_COUNTER, _counter_cap);
+}
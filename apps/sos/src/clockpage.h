@@ -0,0 +1,44 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _CLOCKPAGE_H_
+#define _CLOCKPAGE_H_
+
+#include <stdint.h>
+#include <sel4/sel4.h>
+
+#include "process.h"
+
+/**
+ * Starts the free running timer behind time stamps and prepares the page
+ * through which processes read it. See struct sos_clock in sos_syscall.h.
+ * @param interrupt_ep the badged endpoint for the timer's wrap interrupt
+ */
+void clock_page_init(seL4_CPtr interrupt_ep);
+
+/**
+ * @return microseconds since boot, read the same way as processes do
+ */
+uint64_t clock_page_time(void);
+
+/**
+ * Handles the timer's wrap and tick interrupts. Ticks arrive every
+ * 100ms or so, and are handled by the caller.
+ */
+void clock_page_irq(void);
+
+/**
+ * Maps the clock into a new process, read only. A clone shares it along
+ * with the rest of its parent's address space.
+ * @return 0 on success
+ */
+int clock_page_map(process_t* proc);
+
+#endif /* _CLOCKPAGE_H_ */
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * The serial console. Any number of processes may write to it, but only
+ * one may have it open for reading. Input that arrives while nobody is
+ * reading is buffered.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <serial/serial.h>
+#include <sos_syscall.h>
+
+#include "console.h"
+#include "syscall.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+/* Size of the buffer for input nobody is waiting for */
+#define CONSOLE_BUF_SIZE    (1024)
+
+static struct serial* _serial = NULL;
+
+/* Input not yet read */
+static char _buf[CONSOLE_BUF_SIZE];
+static int _buf_head = 0;
+static int _buf_count = 0;
+
+/* The file the console is open for reading through, if any */
+static struct file* _reader = NULL;
+
+/* A read waiting for input, which is copied straight into the reader's
+ * buffer as it arrives */
+static struct {
+    struct file* file;
+    syscall_caller_t caller;
+    char* data;
+    size_t nbyte;
+    size_t count;
+} _pending;
+
+static void
+_console_complete(void){
+    struct file* file = _pending.file;
+
+    assert(file != NULL);
+    _pending.file = NULL;
+    syscall_reply(_pending.caller, _pending.count);
+    file_put(file);
+}
+
+static void
+_console_handler(struct serial* serial, char c){
+    if(_pending.file != NULL){
+        process_t* proc = process_lookup(_pending.caller.pid);
+        if(proc != NULL){
+            _pending.data[_pending.count++] = c;
+        }
+        if(proc == NULL || c == '\n' || _pending.count == _pending.nbyte){
+            _console_complete();
+        }
+        return;
+    }
+
+    if(_buf_count == CONSOLE_BUF_SIZE){
+        dprintf(0, "console: input buffer full, dropping input\n");
+        return;
+    }
+    _buf[(_buf_head + _buf_count) % CONSOLE_BUF_SIZE] = c;
+    _buf_count++;
+}
+
+/*
+ * Copies buffered input to the reader, up to and including the first
+ * newline
+ * @return the number of bytes copied
+ */
+static int
+_console_drain(char* data, size_t nbyte){
+    size_t count = 0;
+
+    while(count < nbyte && _buf_count > 0){
+        char c = _buf[_buf_head];
+        data[count] = c;
+        _buf_head = (_buf_head + 1) % CONSOLE_BUF_SIZE;
+        _buf_count--;
+        count++;
+        if(c == '\n'){
+            break;
+        }
+    }
+    return count;
+}
+
+static int
+_console_read(struct file* file, syscall_ctx_t* ctx, process_t* proc,
+              char* data, size_t nbyte){
+    assert(file == _reader);
+    if(_pending.file != NULL){
+        /* Shared with a clone that is already reading */
+        return -1;
+    }
+
+    if(_buf_count > 0){
+        return _console_drain(data, nbyte);
+    }
+
+    file_ref(file);
+    _pending.file = file;
+    _pending.data = data;
+    _pending.nbyte = nbyte;
+    _pending.count = 0;
+    _pending.caller = syscall_defer(ctx);
+    return 0;
+}
+
+static int
+_console_write(struct file* file, syscall_ctx_t* ctx, process_t* proc,
+               char* data, size_t nbyte){
+    return serial_send(_serial, data, nbyte);
+}
+
+static void
+_console_close(struct file* file){
+    if(file == _reader){
+        _reader = NULL;
+    }
+}
+
+static const struct file_ops _console_ops = {
+    .read = _console_read,
+    .write = _console_write,
+    .close = _console_close,
+};
+
+struct file*
+console_open(int mode){
+    struct file* file;
+
+    if(mode != SOS_O_WRONLY && _reader != NULL){
+        return NULL;
+    }
+    file = file_alloc(&_console_ops, mode);
+    if(file == NULL){
+        return NULL;
+    }
+    if(mode != SOS_O_WRONLY){
+        _reader = file;
+    }
+    return file;
+}
+
+void
+console_init(void){
+    int err;
+
+    _serial = serial_init();
+    conditional_panic(_serial == NULL, "Failed to initialise the console");
+    err = serial_register_handler(_serial, _console_handler);
+    conditional_panic(err, "Failed to register the console handler");
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+#include "file.h"
+
+/* Path under which processes open the console */
+#define CONSOLE_NAME        "console"
+
+/**
+ * Starts receiving input from the serial console
+ * @pre the network must be initialised
+ */
+void console_init(void);
+
+/**
+ * Opens the console
+ * @param mode the access mode
+ * @return the new open file, or NULL if the console is already open for
+ *         reading or we are out of memory
+ */
+struct file* console_open(int mode);
+
+#endif /* _CONSOLE_H_ */
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Continuations. SOS has a single thread, so work that needs the pager
+ * cannot wait for it without holding up every other process. Instead
+ * the work is written as a step that does as much as it can, starts
+ * whatever I/O it needs and returns. It is parked until that I/O
+ * completes and then run again from the syscall loop.
+ */
+#include <stdint.h>
+#include <assert.h>
+
+#include "cont.h"
+#include "frametable.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+/* Continuations waiting to be run again, highest priority first */
+static struct cont* _parked = NULL;
+
+/*
+ * Parks a continuation behind any others of the same priority
+ */
+static void
+_cont_park(struct cont* c){
+    struct cont** pp = &_parked;
+
+    while(*pp != NULL && (*pp)->prio >= c->prio){
+        pp = &(*pp)->next;
+    }
+    c->next = *pp;
+    *pp = c;
+}
+
+static void
+_cont_step(struct cont* c){
+    if(c->step(c) == CONT_WAIT){
+        _cont_park(c);
+    }
+}
+
+void
+cont_start(struct cont* c, cont_step_t step, int prio){
+    c->step = step;
+    c->prio = prio;
+    c->woken = 0;
+    c->pending = 0;
+    c->frame_wait = 0;
+    c->err = 0;
+    c->nframes = 0;
+    c->next = NULL;
+    _cont_step(c);
+}
+
+void
+cont_wake(struct cont* c){
+    c->woken = 1;
+}
+
+void
+cont_wake_all(void){
+    struct cont* c;
+    for(c = _parked; c != NULL; c = c->next){
+        c->woken = 1;
+    }
+}
+
+static inline int
+_cont_ready(struct cont* c){
+    return c->woken && c->pending == 0 && !c->frame_wait;
+}
+
+int
+cont_runnable(void){
+    struct cont* c;
+    for(c = _parked; c != NULL; c = c->next){
+        if(_cont_ready(c)){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void
+cont_run(void){
+    int ran = 1;
+
+    /* A step may wake others, so keep going until nothing is ready.
+     * The list is in priority order, so the most urgent go first. */
+    while(ran){
+        struct cont* list = _parked;
+
+        _parked = NULL;
+        ran = 0;
+        while(list != NULL){
+            struct cont* c = list;
+            list = c->next;
+            if(_cont_ready(c)){
+                c->woken = 0;
+                ran = 1;
+                _cont_step(c);
+            }else{
+                _cont_park(c);
+            }
+        }
+    }
+}
+
+static void
+_cont_frame_cb(uintptr_t token, int frame){
+    struct cont* c = (struct cont*)token;
+
+    assert(c->frame_wait);
+    c->frame_wait = 0;
+    if(frame == FRAME_INVALID){
+        c->err = 1;
+    }else{
+        c->frames[c->nframes++] = frame;
+    }
+    cont_wake(c);
+}
+
+int
+cont_reserve_frames(struct cont* c, int n){
+    assert(n <= CONT_MAX_FRAMES);
+    assert(!c->frame_wait);
+
+    while(c->nframes < n){
+        int frame;
+
+        if(c->err){
+            return -1;
+        }
+        c->frame_wait = 1;
+        frame = frame_alloc_async(_cont_frame_cb, (uintptr_t)c, c->prio);
+        if(frame == FRAME_PENDING){
+            /* The callback may already have run if we are out of memory */
+            return CONT_WAIT;
+        }
+        c->frame_wait = 0;
+        if(frame == FRAME_INVALID){
+            return -1;
+        }
+        c->frames[c->nframes++] = frame;
+    }
+    return 0;
+}
+
+void
+cont_release_frames(struct cont* c){
+    assert(!c->frame_wait);
+    while(c->nframes > 0){
+        frame_free(c->frames[--c->nframes]);
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _CONT_H_
+#define _CONT_H_
+
+/* Returned by a step that has finished */
+#define CONT_DONE           (0)
+/* Returned by a step that has to wait and should be run again later */
+#define CONT_WAIT           (1)
+
+/* Most frames a continuation can hold at once */
+#define CONT_MAX_FRAMES     (4)
+
+struct cont;
+
+/**
+ * Performs as much of a piece of work as possible without waiting
+ * @return CONT_DONE, or CONT_WAIT once the continuation has something to
+ *         wait for
+ */
+typedef int (*cont_step_t)(struct cont* c);
+
+/* Work that SOS has to come back to, rather than wait for. It is usually
+ * the first member of a larger structure holding the rest of its state. */
+struct cont {
+    cont_step_t step;
+    int prio;                   /* of the process it works for */
+    int woken;                  /* run the step again at the next chance */
+    int pending;                /* faults taken on its behalf in flight */
+    int frame_wait;             /* a frame has been asked for */
+    int err;                    /* set if any of those failed */
+    int frames[CONT_MAX_FRAMES];
+    int nframes;
+    struct cont* next;
+};
+
+/**
+ * Runs the first step of a continuation. If it has to wait it is run
+ * again whenever it is woken and nothing it started is still in flight,
+ * before any woken continuation of lower priority.
+ * @param c the continuation, which must stay allocated until its step
+ *        returns CONT_DONE
+ * @param step the step to run
+ * @param prio the priority of the process it works for, which also
+ *        orders the faults and frame allocations it waits for
+ */
+void cont_start(struct cont* c, cont_step_t step, int prio);
+
+/**
+ * Marks a waiting continuation to be run again
+ */
+void cont_wake(struct cont* c);
+
+/**
+ * Marks every waiting continuation to be run again. Called by the pager
+ * whenever it finishes with a page.
+ */
+void cont_wake_all(void);
+
+/**
+ * @return non zero if cont_run has a woken continuation to run
+ */
+int cont_runnable(void);
+
+/**
+ * Runs every woken continuation. Called from the syscall loop between
+ * messages, so steps may reply to system calls.
+ */
+void cont_run(void);
+
+/**
+ * Collects frames for a continuation, waiting for the pager if memory is
+ * short. The continuation keeps them across steps until released.
+ * @param n the number of frames needed, at most CONT_MAX_FRAMES
+ * @return 0 once n frames are held, CONT_WAIT if the step must wait, or
+ *         -1 if we are out of memory
+ */
+int cont_reserve_frames(struct cont* c, int n);
+
+/**
+ * Returns the frames held by a continuation to the free pool, from which
+ * the same number of frame_alloc calls are then served without waiting
+ * until SOS next handles a message
+ */
+void cont_release_frames(struct cont* c);
+
+#endif /* _CONT_H_ */
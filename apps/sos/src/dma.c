@@ -51,28 +51,36 @@ static inline void
 _dma_fill(seL4_Word pstart, seL4_Word pend, int cached){
     seL4_CPtr* caps = &_dma_caps[(pstart - _dma_pstart) >> seL4_PageBits];
     seL4_ARM_VMAttributes vm_attr = 0;
-    int err;
 
     if(cached){
         vm_attr = seL4_ARM_Default_VMAttributes;
         vm_attr = 0 /* TODO L2CC currently not controlled by kernel */;
     }
 
+    /* Memory is only ever filled upwards from the first unmapped page, so
+     * the largest frame that fits in the DMA region never overlaps one
+     * already mapped. Note that this mixes cached and uncached
+     * allocations within a frame, which is fine while both are mapped
+     * uncached. */
     pstart -= PAGE_OFFSET(pstart);
     while(pstart < pend){
+        int bits = seL4_PageBits;
         if(*caps == seL4_CapNull){
-            /* Create the frame cap */
-            err = cspace_ut_retype_addr(pstart, seL4_ARM_SmallPageObject,
-                                        seL4_PageBits, cur_cspace, caps);
-            assert(!err);
-            /* Map in the frame */
-            err = map_page(*caps, seL4_CapInitThreadPD, VIRT(pstart), 
-                           seL4_AllRights, vm_attr);
-            assert(!err);
+            seL4_CPtr cap;
+            int i;
+            /* Create and map the frame */
+            bits = map_large_frame(pstart, seL4_CapInitThreadPD, VIRT(pstart),
+                                   _dma_pend - pstart, seL4_AllRights,
+                                   vm_attr, &cap);
+            assert(bits > 0);
+            /* Every page covered by the frame records its cap */
+            for(i = 0; i < (1 << (bits - seL4_PageBits)); i++){
+                caps[i] = cap;
+            }
         }
         /* Next */
-        pstart += (1 << seL4_PageBits);
-        caps++;
+        pstart += (1 << bits);
+        caps += (1 << (bits - seL4_PageBits));
     }
 }
 
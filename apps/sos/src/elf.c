@@ -12,29 +12,20 @@
 #include <elf/elf.h>
 #include <string.h>
 #include <assert.h>
-#include <cspace/cspace.h>
 
 #include "elf.h"
-
-#include <vmem_layout.h>
-#include <ut_manager/ut.h>
-#include <mapping.h>
+#include "imagecache.h"
 
 #define verbose 0
 #include <sys/debug.h>
 #include <sys/panic.h>
 
-/* Minimum of two values. */
-#define MIN(a,b) (((a)<(b))?(a):(b))
-
 #define PAGESIZE              (1 << (seL4_PageBits))
 #define PAGEMASK              ((PAGESIZE) - 1)
 #define PAGE_ALIGN(addr)      ((addr) & ~(PAGEMASK))
 #define IS_PAGESIZE_ALIGNED(addr) !((addr) &  (PAGEMASK))
 
 
-extern seL4_ARM_PageDirectory dest_as;
-
 /*
  * Convert ELF permissions into seL4 permissions.
  */
@@ -52,10 +43,12 @@ static inline seL4_Word get_sel4_rights_from_elf(unsigned long permissions) {
 }
 
 /*
- * Inject data into the given vspace.
- * TODO: Don't keep these pages mapped in
+ * Register a segment with the given address space. Nothing is loaded
+ * here: each page is filled from the ELF image in the cpio archive, or
+ * with zeros, the first time the process touches it. Read only segments
+ * are backed by frames shared with other instances of the same program.
  */
-static int load_segment_into_vspace(seL4_ARM_PageDirectory dest_as,
+static int load_segment_into_vspace(addrspace_t *as, char *elf_file, int index,
                                     char *src, unsigned long segment_size,
                                     unsigned long file_size, unsigned long dst,
                                     unsigned long permissions) {
@@ -78,71 +71,37 @@ static int load_segment_into_vspace(seL4_ARM_PageDirectory dest_as,
        Note: if file_size == segment_size, there is no zero-filled region.
        Note: if file_size == 0, the whole segment is just zero filled.
 
-       The code below relies on seL4's frame allocator already
-       zero-filling a newly allocated frame.
+       The fault handler relies on new frames being zero filled and
+       copies in the file content where a page overlaps it. Reads of
+       pages that are entirely zero share a single zero frame until
+       they are first written.
 
     */
 
-
+    region_t *region;
 
     assert(file_size <= segment_size);
 
-    unsigned long pos;
-
-    /* We work a page at a time in the destination vspace. */
-    pos = 0;
-    while(pos < segment_size) {
-        seL4_Word paddr;
-        seL4_CPtr sos_cap, tty_cap;
-        seL4_Word vpage, kvpage;
-        unsigned long kdst;
-        int nbytes;
-        int err;
-
-        kdst   = dst + PROCESS_SCRATCH;
-        vpage  = PAGE_ALIGN(dst);
-        kvpage = PAGE_ALIGN(kdst);
-
-        /* First we need to create a frame */
-        paddr = ut_alloc(seL4_PageBits);
-        conditional_panic(!paddr, "Out of memory - could not allocate frame");
-        err = cspace_ut_retype_addr(paddr,
-                                    seL4_ARM_SmallPageObject,
-                                    seL4_PageBits,
-                                    cur_cspace,
-                                    &tty_cap);
-        conditional_panic(err, "Failed to retype to a frame object");
-
-        /* Copy the frame cap as we need to map it into 2 address spaces */
-        sos_cap = cspace_copy_cap(cur_cspace, cur_cspace, tty_cap, seL4_AllRights);
-        conditional_panic(sos_cap == 0, "Failed to copy frame cap");
-
-        /* Map the frame into tty_test address spaces */
-        err = map_page(tty_cap, dest_as, vpage, permissions, 
-                       seL4_ARM_Default_VMAttributes);
-        conditional_panic(err, "Failed to map to tty address space");
-        /* Map the frame into sos address spaces */
-        err = map_page(sos_cap, seL4_CapInitThreadPD, kvpage, seL4_AllRights, 
-                       seL4_ARM_Default_VMAttributes);
-        conditional_panic(err, "Failed to map sos address space");
-
-        /* Now copy our data into the destination vspace. */
-        nbytes = PAGESIZE - (dst & PAGEMASK);
-        if (pos < file_size){
-            memcpy((void*)kdst, (void*)src, MIN(nbytes, file_size - pos));
+    region = as_define_region(as, PAGE_ALIGN(dst),
+                              segment_size + (dst & PAGEMASK), permissions);
+    if (region == NULL) {
+        return !0;
+    }
+    region->data = src;
+    region->data_vbase = dst;
+    region->data_size = file_size;
+
+    if (!(permissions & seL4_CanWrite)) {
+        region->shared = image_segment_get(elf_file, index,
+                                           (region->vend - region->vbase) >> seL4_PageBits);
+        if (region->shared == NULL) {
+            return !0;
         }
-
-        /* Not observable to I-cache yet so flush the frame */
-        seL4_ARM_Page_Unify_Instruction(sos_cap, 0, PAGESIZE);
-
-        pos += nbytes;
-        dst += nbytes;
-        src += nbytes;
     }
     return 0;
 }
 
-int elf_load(seL4_ARM_PageDirectory dest_as, char *elf_file) {
+int elf_load(addrspace_t *as, char *elf_file) {
 
     int num_headers;
     int err;
@@ -169,11 +128,13 @@ int elf_load(seL4_ARM_PageDirectory dest_as, char *elf_file) {
         vaddr = elf_getProgramHeaderVaddr(elf_file, i);
         flags = elf_getProgramHeaderFlags(elf_file, i);
 
-        /* Copy it across into the vspace. */
+        /* Register it with the vspace. */
         dprintf(1, " * Loading segment %08x-->%08x\n", (int)vaddr, (int)(vaddr + segment_size));
-        err = load_segment_into_vspace(dest_as, source_addr, segment_size, file_size, vaddr,
+        err = load_segment_into_vspace(as, elf_file, i, source_addr, segment_size, file_size, vaddr,
                                        get_sel4_rights_from_elf(flags) & seL4_AllRights);
-        conditional_panic(err != 0, "Elf loading failed!\n");
+        if (err) {
+            return err;
+        }
     }
 
     return 0;
@@ -13,6 +13,15 @@
 
 #include <sel4/sel4.h>
 
-int elf_load(seL4_ARM_PageDirectory dest_pd, char* elf_file);
+#include "addrspace.h"
+
+/**
+ * Loads an ELF image into an address space. A region is defined for
+ * each loadable segment, backed by the image itself. Pages are populated
+ * lazily by the fault handler, so the image must stay in memory for the
+ * life of the address space.
+ * @return 0 on success
+ */
+int elf_load(addrspace_t* as, char* elf_file);
 
 #endif /* _LIBOS_ELF_H_ */
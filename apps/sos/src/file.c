@@ -0,0 +1,236 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Per process file descriptors. Each descriptor refers to an entry in the
+ * open file table, whose operations depend on where it was opened: the
+ * console or NFS. A bitmap of the descriptors in use, with a summary word
+ * marking which of its words are full, finds the lowest free descriptor
+ * in two count trailing zero instructions.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <autoconf.h>
+#include <sos_syscall.h>
+#include <utils/util.h>
+
+#include "console.h"
+#include "file.h"
+#include "nfsfile.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+/* Files open at once across all processes */
+#define SOS_OPEN_FILES      (CONFIG_SOS_OPEN_FILES)
+
+/* The open file table. Entries below _files_used have been handed out
+ * at least once; those since closed are on the free list. */
+static struct file _files[SOS_OPEN_FILES];
+static int _files_used = 0;
+static struct file* _files_free = NULL;
+
+/*************************
+ *** Open file table ***
+ *************************/
+
+struct file*
+file_alloc(const struct file_ops* ops, int mode){
+    struct file* file;
+
+    if(_files_free != NULL){
+        file = _files_free;
+        _files_free = file->next;
+    }else if(_files_used < SOS_OPEN_FILES){
+        file = &_files[_files_used++];
+    }else{
+        dprintf(0, "file: the open file table is full\n");
+        return NULL;
+    }
+    memset(file, 0, sizeof(*file));
+    file->ops = ops;
+    file->mode = mode;
+    file->refs = 1;
+    return file;
+}
+
+void
+file_ref(struct file* file){
+    assert(file->refs > 0);
+    file->refs++;
+}
+
+void
+file_put(struct file* file){
+    assert(file->refs > 0);
+    if(--file->refs == 0){
+        if(file->ops->close != NULL){
+            file->ops->close(file);
+        }
+        file->next = _files_free;
+        _files_free = file;
+    }
+}
+
+/*************************
+ *** Descriptors ***
+ *************************/
+
+/*
+ * Marks the lowest free descriptor of a process as in use
+ * @return its index in proc->files, or -1 if there is none
+ */
+static int
+_fd_alloc(process_t* proc){
+    uint32_t free_words = ~proc->fd_full;
+    int word, bit, i;
+
+    if(free_words == 0){
+        return -1;
+    }
+    word = CTZ(free_words);
+    if(word >= PROCESS_FD_WORDS){
+        return -1;
+    }
+    /* The last word may have no free bits below PROCESS_MAX_FILES without
+     * being marked full */
+    bit = CTZ(~proc->fd_used[word]);
+    i = word * 32 + bit;
+    if(i >= PROCESS_MAX_FILES){
+        return -1;
+    }
+    proc->fd_used[word] |= BIT(bit);
+    if(proc->fd_used[word] == ~0U){
+        proc->fd_full |= BIT(word);
+    }
+    return i;
+}
+
+static void
+_fd_free(process_t* proc, int i){
+    proc->fd_used[i / 32] &= ~BIT(i % 32);
+    proc->fd_full &= ~BIT(i / 32);
+    proc->files[i] = NULL;
+}
+
+static struct file*
+_file_lookup(process_t* proc, int fd){
+    if(fd < FILE_FIRST_FD || fd >= FILE_FIRST_FD + PROCESS_MAX_FILES){
+        return NULL;
+    }
+    return proc->files[fd - FILE_FIRST_FD];
+}
+
+int
+file_open(syscall_ctx_t* ctx, process_t* proc, const char* path, int mode){
+    struct file* file;
+
+    mode &= SOS_O_ACCMODE;
+    if(mode != SOS_O_RDONLY && mode != SOS_O_WRONLY && mode != SOS_O_RDWR){
+        return -1;
+    }
+
+    if(strcmp(path, CONSOLE_NAME) != 0){
+        return nfsfile_open(ctx, proc, path, mode);
+    }
+    file = console_open(mode);
+    if(file == NULL){
+        return -1;
+    }
+    return file_install(proc, file);
+}
+
+int
+file_install(process_t* proc, struct file* file){
+    int i = _fd_alloc(proc);
+
+    if(i < 0){
+        dprintf(0, "file: process %d has too many open files\n", proc->pid);
+        file_put(file);
+        return -1;
+    }
+    proc->files[i] = file;
+    return FILE_FIRST_FD + i;
+}
+
+int
+file_close(process_t* proc, int fd){
+    struct file* file = _file_lookup(proc, fd);
+    if(file == NULL){
+        return -1;
+    }
+    _fd_free(proc, fd - FILE_FIRST_FD);
+    file_put(file);
+    return 0;
+}
+
+void
+file_close_all(process_t* proc){
+    int word;
+
+    /* Only the descriptors in use are visited */
+    for(word = 0; word < PROCESS_FD_WORDS; word++){
+        while(proc->fd_used[word] != 0){
+            int i = word * 32 + CTZ(proc->fd_used[word]);
+            struct file* file = proc->files[i];
+
+            _fd_free(proc, i);
+            file_put(file);
+        }
+    }
+}
+
+void
+file_clone_all(process_t* proc, process_t* parent){
+    int word;
+
+    memcpy(proc->fd_used, parent->fd_used, sizeof(proc->fd_used));
+    proc->fd_full = parent->fd_full;
+    for(word = 0; word < PROCESS_FD_WORDS; word++){
+        uint32_t used = proc->fd_used[word];
+
+        while(used != 0){
+            int i = word * 32 + CTZ(used);
+
+            used &= used - 1;
+            proc->files[i] = parent->files[i];
+            file_ref(proc->files[i]);
+        }
+    }
+}
+
+int
+file_read(syscall_ctx_t* ctx, process_t* proc, int fd, char* data,
+          size_t nbyte){
+    struct file* file = _file_lookup(proc, fd);
+    if(file == NULL || (file->mode & SOS_O_ACCMODE) == SOS_O_WRONLY){
+        return -1;
+    }
+    if(nbyte == 0){
+        return 0;
+    }
+    return file->ops->read(file, ctx, proc, data, nbyte);
+}
+
+int
+file_write(syscall_ctx_t* ctx, process_t* proc, int fd, char* data,
+           size_t nbyte){
+    struct file* file = _file_lookup(proc, fd);
+    if(file == NULL || (file->mode & SOS_O_ACCMODE) == SOS_O_RDONLY){
+        return -1;
+    }
+    if(nbyte == 0){
+        return 0;
+    }
+    return file->ops->write(file, ctx, proc, data, nbyte);
+}
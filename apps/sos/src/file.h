@@ -0,0 +1,122 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _FILE_H_
+#define _FILE_H_
+
+#include <stddef.h>
+#include <sel4/sel4.h>
+#include <nfs/nfs.h>
+
+#include "process.h"
+
+/* The first descriptor handed out by open. Lower ones are taken to be
+ * the console by libc */
+#define FILE_FIRST_FD       (3)
+
+struct file;
+
+/* Operations on an open file. Data is moved through memory the process
+ * shares with SOS, its I/O buffer or submission ring, which stays mapped
+ * for as long as the process exists. Read and write return the number of
+ * bytes transferred or -1. An operation that has to wait calls
+ * syscall_defer on ctx and later completes the system call with
+ * syscall_reply, touching the data only if the process still exists.
+ * Close, if set, is called with the last reference, after which the
+ * entry is reused. */
+struct file_ops {
+    int (*read)(struct file* file, syscall_ctx_t* ctx, process_t* proc,
+                char* data, size_t nbyte);
+    int (*write)(struct file* file, syscall_ctx_t* ctx, process_t* proc,
+                 char* data, size_t nbyte);
+    void (*close)(struct file* file);
+};
+
+/* An entry in the open file table, shared by every descriptor that
+ * refers to it */
+struct file {
+    const struct file_ops* ops;
+    int mode;                   /* SOS_O_RDONLY, SOS_O_WRONLY or SOS_O_RDWR */
+    fhandle_t fh;               /* NFS files only */
+    fattr_t attr;               /* NFS files only, as of the last reply */
+    size_t offset;
+    int refs;                   /* descriptors and I/O in flight */
+    struct file* next;          /* in the free list */
+};
+
+/**
+ * Takes a free entry from the open file table
+ * @param ops the operations on the file
+ * @param mode the mode it was opened with
+ * @return the file, holding one reference, or NULL if the table is full
+ */
+struct file* file_alloc(const struct file_ops* ops, int mode);
+
+/**
+ * Opens a file on behalf of a process. Paths name files on the NFS
+ * mount, except for "console". May defer the system call.
+ * @return the new descriptor or -1
+ */
+int file_open(syscall_ctx_t* ctx, process_t* proc, const char* path,
+              int mode);
+
+/**
+ * Installs a newly opened file in the first free descriptor of a
+ * process. The file is closed if there is no free descriptor.
+ * @return the descriptor or -1
+ */
+int file_install(process_t* proc, struct file* file);
+
+/**
+ * Takes a reference to an open file, keeping it alive while I/O is in
+ * flight or while it is shared by a cloned process
+ */
+void file_ref(struct file* file);
+
+/**
+ * Drops a reference to an open file, closing it with the last reference
+ */
+void file_put(struct file* file);
+
+/**
+ * Closes a file descriptor
+ * @return 0 on success, -1 if fd is not open
+ */
+int file_close(process_t* proc, int fd);
+
+/**
+ * Closes every file a process has open
+ */
+void file_close_all(process_t* proc);
+
+/**
+ * Gives a new process the same descriptors as another, each referring to
+ * the same open file
+ * @param proc the new process, which has no files open
+ */
+void file_clone_all(process_t* proc, process_t* parent);
+
+/**
+ * Reads from a file descriptor. May defer the system call.
+ * @param data where the data goes, in memory shared with the process
+ * @return the number of bytes read or -1
+ */
+int file_read(syscall_ctx_t* ctx, process_t* proc, int fd, char* data,
+              size_t nbyte);
+
+/**
+ * Writes to a file descriptor. May defer the system call.
+ * @param data the data, in memory shared with the process
+ * @return the number of bytes written or -1
+ */
+int file_write(syscall_ctx_t* ctx, process_t* proc, int fd, char* data,
+               size_t nbyte);
+
+#endif /* _FILE_H_ */
@@ -0,0 +1,728 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * The frame table keeps one entry for every frame in the memory managed
+ * by ut_alloc, indexed by physical frame number. The table itself can be
+ * far larger than the SOS heap so it is backed by frames mapped at
+ * FRAME_TABLE_VSTART.
+ *
+ * When untyped memory runs out, frames are reclaimed with the clock
+ * (second chance) algorithm. seL4 does not expose referenced bits, so we
+ * emulate them: a frame counts as referenced while it is mapped. The
+ * clock hand unmaps referenced frames and evicts frames that have not
+ * been touched (and hence remapped by the fault handler) since.
+ *
+ * Victims are written back asynchronously in clusters. Allocations that
+ * cannot be satisfied wait in a queue, in priority order, and are handed
+ * victim frames as soon as each one has been written out.
+ *
+ * A page read back from the pagefile keeps its slot for as long as it is
+ * clean, and is mapped read only until it is written to. A clean victim
+ * is reclaimed at once without being written back.
+ *
+ * A frame shared copy on write is listed with every page table entry
+ * sharing it. It counts as referenced if any of them has it mapped, and
+ * when it is evicted they all become swapped entries for the same slot.
+ *
+ * Every frame is mapped into SOS at FRAME_WINDOW for as long as it is
+ * allocated, using the master cap. Processes map copies of that cap.
+ *
+ * A pool of retyped, zero filled frames is kept topped up between
+ * requests so that most allocations are a list pop. Freed frames keep
+ * their caps and go back to the pool to be zeroed later.
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <cspace/cspace.h>
+
+#include <autoconf.h>
+
+#include "frametable.h"
+#include "mapping.h"
+#include "pager.h"
+#include "vmem_layout.h"
+#include "ut_manager/ut.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+#define PAGESIZE              (1 << (seL4_PageBits))
+#define PAGEMASK              ((PAGESIZE) - 1)
+#define PAGE_ALIGN(addr)      ((addr) & ~(PAGEMASK))
+
+#define FRAME_PADDR(f)        (_ft_base + ((f) << seL4_PageBits))
+#define FRAME_VADDR(f)        (FRAME_WINDOW + ((f) << seL4_PageBits))
+#define PADDR_FRAME(p)        (((p) - _ft_base) >> seL4_PageBits)
+
+/* Frame flags */
+#define FRAME_EVICTING        (1 << 1)
+#define FRAME_POOLED          (1 << 2)
+
+/* Target number of frames kept in the pool */
+#define FRAME_POOL_SIZE       (CONFIG_SOS_FRAME_POOL_SIZE)
+/* Most frames prepared by a single call to frame_pool_refill */
+#define FRAME_POOL_BATCH      (4)
+
+/* Another page table entry sharing a frame copy on write */
+struct frame_sharer {
+    pte_t* pte;
+    struct frame_sharer* next;
+};
+
+struct frame_entry {
+    seL4_CPtr cap;              /* SOS's master cap, seL4_CapNull if free */
+    pte_t* pte;                 /* The page table entry mapping this frame */
+    struct frame_sharer* sharers;   /* other entries sharing it, if any */
+    seL4_Word flags;
+    int refs;                   /* page table entries referencing the frame */
+    int pins;                   /* reasons the frame may not be paged out */
+    int slot;                   /* pagefile slot holding a copy, or -1 */
+    int next;                   /* next frame in the pool */
+};
+
+static struct frame_entry* _frame_table = NULL;
+static seL4_Word _ft_base;
+static int _ft_nframes;
+
+/* An allocation waiting for a frame to be written back */
+struct frame_waiter {
+    frame_alloc_cb_t cb;
+    uintptr_t token;
+    int prio;
+    struct frame_waiter* next;
+};
+
+static int _clock_hand = 0;
+static int _zero_frame = FRAME_INVALID;
+
+/* Pooled frames that are ready for use, and those still to be zeroed */
+static int _pool_clean = FRAME_INVALID;
+static int _pool_dirty = FRAME_INVALID;
+static int _pool_nclean = 0;
+static int _pool_ndirty = 0;
+/* Set when refilling ran out of untyped memory */
+static int _pool_starved = 0;
+
+static struct frame_waiter* _waiters_head = NULL;
+static int _nwaiters = 0;
+static int _nevicting = 0;
+
+
+int
+frame_table_init(seL4_Word low, seL4_Word high){
+    seL4_Word vaddr, vend;
+    int err;
+
+    assert(_frame_table == NULL);
+
+    _ft_base = PAGE_ALIGN(low);
+    _ft_nframes = (high - _ft_base) >> seL4_PageBits;
+    conditional_panic(FRAME_VADDR(_ft_nframes) > DEVICE_START,
+                      "Too much memory for the frame window");
+
+    /* Back the table with frames taken straight from the untyped pool */
+    vaddr = FRAME_TABLE_VSTART;
+    vend = FRAME_TABLE_VSTART + _ft_nframes * sizeof(struct frame_entry);
+    for(; vaddr < vend; vaddr += PAGESIZE){
+        seL4_Word paddr;
+        seL4_CPtr cap;
+
+        paddr = ut_alloc(seL4_PageBits);
+        if(paddr == 0){
+            return !0;
+        }
+        err = cspace_ut_retype_addr(paddr, seL4_ARM_SmallPageObject,
+                                    seL4_PageBits, cur_cspace, &cap);
+        conditional_panic(err, "Unable to retype frame table memory");
+        err = map_page(cap, seL4_CapInitThreadPD, vaddr, seL4_AllRights,
+                       seL4_ARM_Default_VMAttributes);
+        conditional_panic(err, "Unable to map frame table memory");
+    }
+
+    _frame_table = (struct frame_entry*)FRAME_TABLE_VSTART;
+    memset(_frame_table, 0, _ft_nframes * sizeof(struct frame_entry));
+
+    dprintf(0, "Frame table: %d frames at 0x%08x\n", _ft_nframes, _ft_base);
+
+    while(_pool_nclean < FRAME_POOL_SIZE && frame_pool_refill() > 0);
+
+    /* Retyped memory is zero filled; our reference keeps it forever */
+    _zero_frame = frame_alloc_async(NULL, 0, FRAME_PRIO_SOS);
+    if(_zero_frame == FRAME_INVALID){
+        return !0;
+    }
+    frame_pin(_zero_frame);
+    return 0;
+}
+
+static void
+_frame_zero(int frame){
+    memset((void*)FRAME_VADDR(frame), 0, PAGESIZE);
+}
+
+static void
+_pool_push(int* head, int frame){
+    _frame_table[frame].flags = FRAME_POOLED;
+    _frame_table[frame].pte = NULL;
+    _frame_table[frame].sharers = NULL;
+    _frame_table[frame].refs = 0;
+    _frame_table[frame].pins = 0;
+    _frame_table[frame].slot = -1;
+    _frame_table[frame].next = *head;
+    *head = frame;
+}
+
+static int
+_pool_pop(int* head){
+    int frame = *head;
+    if(frame != FRAME_INVALID){
+        *head = _frame_table[frame].next;
+        _frame_table[frame].flags = 0;
+        _frame_table[frame].refs = 1;
+    }
+    return frame;
+}
+
+/*
+ * Retypes a new frame from the untyped pool
+ */
+static int
+_frame_retype(void){
+    seL4_Word paddr;
+    seL4_CPtr cap;
+    int frame;
+    int err;
+
+    paddr = ut_alloc(seL4_PageBits);
+    if(paddr == 0){
+        return FRAME_INVALID;
+    }
+    err = cspace_ut_retype_addr(paddr, seL4_ARM_SmallPageObject,
+                                seL4_PageBits, cur_cspace, &cap);
+    conditional_panic(err, "Failed to retype to a frame object");
+
+    frame = PADDR_FRAME(paddr);
+    assert(frame >= 0 && frame < _ft_nframes);
+    assert(_frame_table[frame].cap == seL4_CapNull);
+
+    /* Enter it into the window. This may need a page table, for which
+     * there may be no memory left */
+    err = map_page(cap, seL4_CapInitThreadPD, FRAME_VADDR(frame),
+                   seL4_AllRights, seL4_ARM_Default_VMAttributes);
+    if(err){
+        cspace_delete_cap(cur_cspace, cap);
+        ut_free(paddr, seL4_PageBits);
+        return FRAME_INVALID;
+    }
+
+    _frame_table[frame].cap = cap;
+    _frame_table[frame].pte = NULL;
+    _frame_table[frame].sharers = NULL;
+    _frame_table[frame].flags = 0;
+    _frame_table[frame].refs = 1;
+    _frame_table[frame].pins = 0;
+    _frame_table[frame].slot = -1;
+    return frame;
+}
+
+int
+frame_pool_refill(void){
+    int n;
+
+    for(n = 0; n < FRAME_POOL_BATCH && _pool_nclean < FRAME_POOL_SIZE; n++){
+        int frame;
+        if(_pool_dirty != FRAME_INVALID){
+            frame = _pool_pop(&_pool_dirty);
+            _pool_ndirty--;
+            _frame_zero(frame);
+        }else{
+            /* Retyped memory is already zero filled */
+            frame = _frame_retype();
+            if(frame == FRAME_INVALID){
+                _pool_starved = 1;
+                break;
+            }
+        }
+        _pool_push(&_pool_clean, frame);
+        _pool_nclean++;
+    }
+    return n;
+}
+
+int
+frame_pool_needs_refill(void){
+    return _pool_nclean < FRAME_POOL_SIZE &&
+           (_pool_dirty != FRAME_INVALID || !_pool_starved);
+}
+
+static struct frame_waiter*
+_waiter_pop(void){
+    struct frame_waiter* w = _waiters_head;
+    if(w != NULL){
+        _waiters_head = w->next;
+        _nwaiters--;
+    }
+    return w;
+}
+
+static void _frame_evict(void);
+
+/*
+ * A frame has been taken from its owner. Hand it to the most urgent
+ * waiting allocation, or back to the untyped pool.
+ */
+static void
+_frame_reclaim(int frame){
+    struct frame_entry* fe = &_frame_table[frame];
+    struct frame_waiter* w;
+
+    while(fe->sharers != NULL){
+        struct frame_sharer* s = fe->sharers;
+        fe->sharers = s->next;
+        free(s);
+    }
+    fe->pte = NULL;
+    fe->flags = 0;
+    /* The references of all the sharers went with their entries */
+    fe->refs = 1;
+    w = _waiter_pop();
+    if(w != NULL){
+        _frame_zero(frame);
+        w->cb(w->token, frame);
+        free(w);
+    }else{
+        frame_free(frame);
+    }
+}
+
+/*
+ * Turns a resident page table entry into a swapped entry for slot
+ */
+static void
+_pte_swap_out(pte_t* pte, int slot){
+    cspace_delete_cap(cur_cspace, pte->cap);
+    pte->cap = seL4_CapNull;
+    pte->frame = slot;
+    pte->swapped = 1;
+}
+
+/*
+ * Marks the entries sharing a frame with its owner busy while the owner
+ * is written back, or clears them again
+ */
+static void
+_frame_sharers_busy(struct frame_entry* fe, int busy){
+    struct frame_sharer* s;
+    for(s = fe->sharers; s != NULL; s = s->next){
+        s->pte->busy = busy;
+    }
+}
+
+/*
+ * A victim has been written back (or failed to be)
+ */
+static void
+_frame_pageout_cb(uintptr_t token, int err){
+    int frame = (int)token;
+    struct frame_entry* fe = &_frame_table[frame];
+    struct frame_waiter* w;
+    struct frame_sharer* s;
+
+    _nevicting--;
+    fe->flags &= ~FRAME_EVICTING;
+    if(err){
+        /* The page stays with its owner. Don't retry forever */
+        _frame_sharers_busy(fe, 0);
+        w = _waiter_pop();
+        if(w != NULL){
+            w->cb(w->token, FRAME_INVALID);
+            free(w);
+        }
+    }else{
+        /* The owner now records the slot, which the sharers use too */
+        for(s = fe->sharers; s != NULL; s = s->next){
+            pager_ref_slot(fe->pte->frame);
+            _pte_swap_out(s->pte, fe->pte->frame);
+            s->pte->busy = 0;
+        }
+        _frame_reclaim(frame);
+    }
+    _frame_evict();
+}
+
+/*
+ * Turns the owner and sharers of a clean victim into swapped entries for
+ * the slot that already holds its contents
+ */
+static void
+_frame_drop_clean(struct frame_entry* fe){
+    struct frame_sharer* s;
+
+    for(s = fe->sharers; s != NULL; s = s->next){
+        pager_ref_slot(fe->slot);
+        _pte_swap_out(s->pte, fe->slot);
+    }
+    _pte_swap_out(fe->pte, fe->slot);
+    fe->slot = -1;
+}
+
+/*
+ * Unmaps a frame wherever it is mapped. Returns non zero if it was
+ * mapped anywhere, i.e. it has been referenced since the last pass.
+ */
+static int
+_frame_clear_referenced(struct frame_entry* fe){
+    struct frame_sharer* s;
+    int referenced = 0;
+
+    if(fe->pte->mapped){
+        seL4_ARM_Page_Unmap(fe->pte->cap);
+        fe->pte->mapped = 0;
+        referenced = 1;
+    }
+    for(s = fe->sharers; s != NULL; s = s->next){
+        if(s->pte->mapped){
+            seL4_ARM_Page_Unmap(s->pte->cap);
+            s->pte->mapped = 0;
+            referenced = 1;
+        }
+    }
+    return referenced;
+}
+
+/*
+ * Runs the clock to collect a cluster of frames that have not been
+ * referenced since the last pass. Clean frames are reclaimed at once,
+ * the rest are written back. Nothing happens if enough writeback is
+ * already in flight for the allocations that are waiting.
+ */
+static void
+_frame_evict(void){
+    while(_nevicting < _nwaiters){
+        int frames[PAGER_CLUSTER];
+        pte_t* ptes[PAGER_CLUSTER];
+        int clean[PAGER_CLUSTER];
+        int nframes = 0;
+        int nclean = 0;
+        int started;
+        int i;
+
+        /* Two full sweeps are enough to find a victim if one exists */
+        for(i = 0; i < 2 * _ft_nframes && nframes + nclean < PAGER_CLUSTER;
+            i++){
+            int frame = _clock_hand;
+            struct frame_entry* fe = &_frame_table[frame];
+
+            _clock_hand = (_clock_hand + 1) % _ft_nframes;
+            if(fe->cap == seL4_CapNull || fe->pte == NULL || fe->pins > 0 ||
+               (fe->flags & FRAME_EVICTING)){
+                continue;
+            }
+            if(_frame_clear_referenced(fe)){
+                /* Referenced: clear the bit and give it a second chance */
+                continue;
+            }
+            if(fe->slot >= 0){
+                _frame_drop_clean(fe);
+                clean[nclean++] = frame;
+                continue;
+            }
+            fe->flags |= FRAME_EVICTING;
+            _frame_sharers_busy(fe, 1);
+            frames[nframes] = frame;
+            ptes[nframes] = fe->pte;
+            nframes++;
+        }
+
+        /* Account for the cluster first, callbacks may run immediately */
+        _nevicting += nframes;
+        started = pager_pageout(nframes, frames, ptes, _frame_pageout_cb);
+        for(i = started; i < nframes; i++){
+            _frame_table[frames[i]].flags &= ~FRAME_EVICTING;
+            _frame_sharers_busy(&_frame_table[frames[i]], 0);
+            _nevicting--;
+        }
+
+        for(i = 0; i < nclean; i++){
+            _frame_reclaim(clean[i]);
+        }
+
+        if(nclean == 0){
+            /* Fail any allocations that can no longer be satisfied */
+            while(_nevicting < _nwaiters && started == 0){
+                struct frame_waiter* w = _waiter_pop();
+                w->cb(w->token, FRAME_INVALID);
+                free(w);
+            }
+            return;
+        }
+        /* Clean frames may not have been enough for everyone waiting */
+    }
+}
+
+/*
+ * Queues an allocation behind those of the same or higher priority
+ */
+static void
+_waiter_push(struct frame_waiter* w){
+    struct frame_waiter** pp = &_waiters_head;
+
+    while(*pp != NULL && (*pp)->prio >= w->prio){
+        pp = &(*pp)->next;
+    }
+    w->next = *pp;
+    *pp = w;
+    _nwaiters++;
+}
+
+int
+frame_alloc_async(frame_alloc_cb_t cb, uintptr_t token, int prio){
+    struct frame_waiter* w;
+    int frame;
+
+    assert(_frame_table);
+
+    /* Ideally the pool has one ready for us */
+    frame = _pool_pop(&_pool_clean);
+    if(frame != FRAME_INVALID){
+        _pool_nclean--;
+        return frame;
+    }
+    frame = _pool_pop(&_pool_dirty);
+    if(frame != FRAME_INVALID){
+        _pool_ndirty--;
+        _frame_zero(frame);
+        return frame;
+    }
+
+    frame = _frame_retype();
+    if(frame == FRAME_INVALID){
+        if(cb == NULL){
+            return FRAME_INVALID;
+        }
+        /* Out of memory, wait for a frame to be stolen from a process */
+        w = malloc(sizeof(*w));
+        if(w == NULL){
+            return FRAME_INVALID;
+        }
+        w->cb = cb;
+        w->token = token;
+        w->prio = prio;
+        _waiter_push(w);
+
+        _frame_evict();
+        return FRAME_PENDING;
+    }
+    return frame;
+}
+
+struct frame_alloc_sync {
+    volatile int complete;
+    int frame;
+};
+
+static void
+_frame_alloc_sync_cb(uintptr_t token, int frame){
+    struct frame_alloc_sync* s = (struct frame_alloc_sync*)token;
+    s->frame = frame;
+    s->complete = 1;
+}
+
+int
+frame_alloc(void){
+    struct frame_alloc_sync s;
+    int frame;
+
+    s.complete = 0;
+    frame = frame_alloc_async(_frame_alloc_sync_cb, (uintptr_t)&s,
+                              FRAME_PRIO_SOS);
+    if(frame != FRAME_PENDING){
+        return frame;
+    }
+    pager_wait(&s.complete);
+    return s.frame;
+}
+
+void
+frame_free(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    assert(_frame_table[frame].cap != seL4_CapNull);
+    assert(_frame_table[frame].refs > 0);
+    assert(!(_frame_table[frame].flags & FRAME_POOLED));
+
+    if(--_frame_table[frame].refs > 0){
+        return;
+    }
+    assert(_frame_table[frame].sharers == NULL);
+
+    if(_frame_table[frame].slot >= 0){
+        pager_free_slot(_frame_table[frame].slot);
+        _frame_table[frame].slot = -1;
+    }
+
+    if(_pool_nclean + _pool_ndirty < FRAME_POOL_SIZE){
+        /* Keep the cap; the frame is zeroed before it is reused */
+        _pool_push(&_pool_dirty, frame);
+        _pool_ndirty++;
+        return;
+    }
+
+    /* Deleting the master cap also removes it from the window */
+    cspace_delete_cap(cur_cspace, _frame_table[frame].cap);
+    _frame_table[frame].cap = seL4_CapNull;
+    _frame_table[frame].pte = NULL;
+    _frame_table[frame].flags = 0;
+    ut_free(FRAME_PADDR(frame), seL4_PageBits);
+    _pool_starved = 0;
+}
+
+void
+frame_set_owner(int frame, pte_t* pte){
+    assert(frame >= 0 && frame < _ft_nframes);
+    _frame_table[frame].pte = pte;
+}
+
+int
+frame_share(int frame, pte_t* pte){
+    struct frame_entry* fe;
+    struct frame_sharer* s;
+
+    assert(frame >= 0 && frame < _ft_nframes);
+    fe = &_frame_table[frame];
+    if(fe->pte == NULL){
+        fe->pte = pte;
+        return 0;
+    }
+    s = malloc(sizeof(*s));
+    if(s == NULL){
+        return !0;
+    }
+    s->pte = pte;
+    s->next = fe->sharers;
+    fe->sharers = s;
+    return 0;
+}
+
+void
+frame_unshare(int frame, pte_t* pte){
+    struct frame_entry* fe;
+    struct frame_sharer** sp;
+    struct frame_sharer* s;
+
+    assert(frame >= 0 && frame < _ft_nframes);
+    fe = &_frame_table[frame];
+    if(fe->pte == pte){
+        /* Hand ownership to the next sharer, if there is one */
+        s = fe->sharers;
+        fe->pte = (s != NULL) ? s->pte : NULL;
+        if(s != NULL){
+            fe->sharers = s->next;
+            free(s);
+        }
+        return;
+    }
+    for(sp = &fe->sharers; *sp != NULL; sp = &(*sp)->next){
+        if((*sp)->pte == pte){
+            s = *sp;
+            *sp = s->next;
+            free(s);
+            return;
+        }
+    }
+}
+
+void
+frame_set_slot(int frame, int slot){
+    assert(frame >= 0 && frame < _ft_nframes);
+    assert(_frame_table[frame].slot < 0);
+    _frame_table[frame].slot = slot;
+}
+
+int
+frame_slot(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    return _frame_table[frame].slot;
+}
+
+void
+frame_mark_dirty(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    if(_frame_table[frame].slot >= 0){
+        pager_free_slot(_frame_table[frame].slot);
+        _frame_table[frame].slot = -1;
+    }
+}
+
+void
+frame_ref(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    assert(_frame_table[frame].cap != seL4_CapNull);
+    _frame_table[frame].refs++;
+}
+
+int
+frame_refcount(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    return _frame_table[frame].refs;
+}
+
+void
+frame_pin(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    _frame_table[frame].pins++;
+}
+
+void
+frame_unpin(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    assert(_frame_table[frame].pins > 0);
+    _frame_table[frame].pins--;
+}
+
+int
+frame_is_pinned(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    return _frame_table[frame].pins > 0;
+}
+
+int
+frame_get_zero(void){
+    assert(_zero_frame != FRAME_INVALID);
+    return _zero_frame;
+}
+
+void*
+frame_vaddr(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    assert(_frame_table[frame].cap != seL4_CapNull);
+    return (void*)FRAME_VADDR(frame);
+}
+
+void
+frame_sync_icache(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    seL4_ARM_Page_Unify_Instruction(_frame_table[frame].cap, 0, PAGESIZE);
+}
+
+seL4_CPtr
+frame_cap(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    return _frame_table[frame].cap;
+}
+
+seL4_Word
+frame_paddr(int frame){
+    assert(frame >= 0 && frame < _ft_nframes);
+    return FRAME_PADDR(frame);
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _FRAMETABLE_H_
+#define _FRAMETABLE_H_
+
+#include <stdint.h>
+#include <sel4/sel4.h>
+#include <sos_syscall.h>
+
+#include "addrspace.h"
+
+/* Returned by frame_alloc when no frame could be allocated */
+#define FRAME_INVALID (-1)
+/* Returned by frame_alloc_async when the frame will be delivered later */
+#define FRAME_PENDING (-2)
+
+/* Priority of the allocations SOS waits for itself, ahead of those made
+ * for any process */
+#define FRAME_PRIO_SOS (SOS_PRIO_MAX + 1)
+
+/**
+ * Delivers a frame allocated by frame_alloc_async
+ * @param token the token passed to frame_alloc_async
+ * @param frame the new frame, or FRAME_INVALID on failure
+ */
+typedef void (*frame_alloc_cb_t)(uintptr_t token, int frame);
+
+/**
+ * Initialises the frame table to cover the memory managed by ut_alloc
+ * @pre the untyped allocator and cspace must be initialised
+ * @param low the lowest physical address that ut_alloc may return
+ * @param high the highest physical address that ut_alloc may return +1
+ * @return 0 on success
+ */
+int frame_table_init(seL4_Word low, seL4_Word high);
+
+/**
+ * Allocates a zero filled frame for use by a user process.
+ * If no memory is left, a cluster of victims is chosen by the clock
+ * algorithm and written back to the pagefile. The caller is handed the
+ * first victim to finish, without waiting for the rest of the cluster.
+ * @param cb called with the frame if it cannot be allocated immediately.
+ *           It may be called before frame_alloc_async returns. If NULL,
+ *           the allocation fails instead of waiting.
+ * @param token passed to cb
+ * @param prio the priority of the process the frame is for. Waiting
+ *        allocations are handed frames highest priority first.
+ * @return the frame number of the new frame, FRAME_PENDING if cb will
+ *         deliver the frame, or FRAME_INVALID if we are out of memory
+ *         and nothing could be paged out
+ */
+int frame_alloc_async(frame_alloc_cb_t cb, uintptr_t token, int prio);
+
+/**
+ * Allocates a zero filled frame, polling the network until any
+ * writeback required to free one completes.
+ * @return the frame number of the new frame, or FRAME_INVALID if
+ *         we are out of memory and nothing could be paged out
+ */
+int frame_alloc(void);
+
+/**
+ * Tops up the pool of zero filled frames from which allocations are
+ * served. Only a small batch of work is done, so this may be called
+ * between requests whenever SOS would otherwise go idle.
+ * @return the number of frames added to the pool
+ */
+int frame_pool_refill(void);
+
+/**
+ * @return non zero if frame_pool_refill has work it could do
+ */
+int frame_pool_needs_refill(void);
+
+/**
+ * Drops a reference to a frame. The frame is returned to the untyped
+ * allocator along with the last reference.
+ * @pre the caller's copies of the frame cap must have been deleted
+ * @param frame the frame number returned by frame_alloc
+ */
+void frame_free(int frame);
+
+/**
+ * Records that a pagefile slot holds the frame's current contents, so
+ * that the frame can be evicted without being written back. The slot
+ * then belongs to the frame table.
+ * @param frame the frame number returned by frame_alloc
+ * @param slot the pagefile slot the frame was read from
+ */
+void frame_set_slot(int frame, int slot);
+
+/**
+ * Returns the pagefile slot holding a copy of a frame, or -1 if the
+ * frame has been written to since it was read in (or never paged)
+ * @param frame the frame number returned by frame_alloc
+ */
+int frame_slot(int frame);
+
+/**
+ * Records that a frame is about to be written to, releasing any pagefile
+ * slot that holds a copy of it
+ * @param frame the frame number returned by frame_alloc
+ */
+void frame_mark_dirty(int frame);
+
+/**
+ * Takes another reference to a frame, e.g. to share it copy on write.
+ * Each page table entry holding a reference should be recorded with
+ * frame_share, so that the frame can still be paged out.
+ * @param frame the frame number returned by frame_alloc
+ */
+void frame_ref(int frame);
+
+/**
+ * Records another page table entry sharing a frame copy on write. The
+ * first entry recorded becomes the owner if the frame has none. When the
+ * frame is paged out every sharer becomes a swapped entry.
+ * @param frame the frame number returned by frame_alloc
+ * @param pte the sharing page table entry
+ * @return 0 on success
+ */
+int frame_share(int frame, pte_t* pte);
+
+/**
+ * Forgets a page table entry that shares a frame, before its reference
+ * is dropped. If it was the owner, another sharer takes over. Entries
+ * that were never recorded are ignored.
+ * @param frame the frame number returned by frame_alloc
+ * @param pte the page table entry giving up the frame
+ */
+void frame_unshare(int frame, pte_t* pte);
+
+/**
+ * Returns the number of references held to a frame
+ * @param frame the frame number returned by frame_alloc
+ */
+int frame_refcount(int frame);
+
+/**
+ * Records the page table entry that maps a frame. Only frames with an
+ * owner are candidates for eviction.
+ * @param frame the frame number returned by frame_alloc
+ * @param pte the owning page table entry, or NULL to clear the owner
+ */
+void frame_set_owner(int frame, pte_t* pte);
+
+/**
+ * Prevents a frame from being paged out. Use this for frames that
+ * SOS or the kernel reference by something other than the owner's
+ * page table entry. Pins are counted, so each must be undone
+ * separately.
+ * @param frame the frame number returned by frame_alloc
+ */
+void frame_pin(int frame);
+
+/**
+ * Releases a pin taken by frame_pin
+ * @param frame the frame number returned by frame_alloc
+ */
+void frame_unpin(int frame);
+
+/**
+ * Returns non zero if a frame has been pinned
+ * @param frame the frame number returned by frame_alloc
+ */
+int frame_is_pinned(int frame);
+
+/**
+ * Returns SOS's frame of zeros. Processes may map it read only in place
+ * of untouched anonymous memory, taking a reference with frame_ref.
+ * The frame is never freed or paged out.
+ */
+int frame_get_zero(void);
+
+/**
+ * Returns the address at which an allocated frame's contents are
+ * permanently mapped in SOS
+ * @param frame the frame number returned by frame_alloc
+ */
+void* frame_vaddr(int frame);
+
+/**
+ * Makes instructions written to a frame through SOS's mapping visible
+ * to the instruction cache
+ * @param frame the frame number returned by frame_alloc
+ */
+void frame_sync_icache(int frame);
+
+/**
+ * Returns SOS's master capability to an allocated frame. Mappings
+ * should be made through copies of this cap.
+ * @param frame the frame number returned by frame_alloc
+ */
+seL4_CPtr frame_cap(int frame);
+
+/**
+ * Returns the physical address of an allocated frame
+ * @param frame the frame number returned by frame_alloc
+ */
+seL4_Word frame_paddr(int frame);
+
+#endif /* _FRAMETABLE_H_ */
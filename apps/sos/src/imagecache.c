@@ -0,0 +1,94 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Caches the frames backing the read only segments (text and rodata) of
+ * running executables, so that a program started many times only pays
+ * for its text once. Executables are identified by their location in the
+ * cpio archive, which never moves.
+ */
+#include <stdlib.h>
+#include <assert.h>
+
+#include "frametable.h"
+#include "imagecache.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+static struct image_segment* _segments = NULL;
+
+struct image_segment*
+image_segment_get(const char* elf_file, int index, int npages){
+    struct image_segment* seg;
+    int i;
+
+    for(seg = _segments; seg != NULL; seg = seg->next){
+        if(seg->elf_file == elf_file && seg->index == index){
+            assert(seg->npages == npages);
+            seg->refcount++;
+            return seg;
+        }
+    }
+
+    seg = malloc(sizeof(*seg));
+    if(seg == NULL){
+        return NULL;
+    }
+    seg->frames = malloc(npages * sizeof(int));
+    if(seg->frames == NULL){
+        free(seg);
+        return NULL;
+    }
+    for(i = 0; i < npages; i++){
+        seg->frames[i] = FRAME_INVALID;
+    }
+    seg->elf_file = elf_file;
+    seg->index = index;
+    seg->refcount = 1;
+    seg->npages = npages;
+    seg->next = _segments;
+    _segments = seg;
+
+    dprintf(1, "Caching segment %d of image %p (%d pages)\n",
+            index, elf_file, npages);
+    return seg;
+}
+
+void
+image_segment_ref(struct image_segment* seg){
+    assert(seg->refcount > 0);
+    seg->refcount++;
+}
+
+void
+image_segment_put(struct image_segment* seg){
+    struct image_segment** prev;
+    int i;
+
+    assert(seg->refcount > 0);
+    if(--seg->refcount > 0){
+        return;
+    }
+
+    for(prev = &_segments; *prev != seg; prev = &(*prev)->next){
+        assert(*prev != NULL);
+    }
+    *prev = seg->next;
+
+    for(i = 0; i < seg->npages; i++){
+        if(seg->frames[i] != FRAME_INVALID){
+            frame_free(seg->frames[i]);
+        }
+    }
+    free(seg->frames);
+    free(seg);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _IMAGECACHE_H_
+#define _IMAGECACHE_H_
+
+#include <sel4/sel4.h>
+
+/* The frames backing one read only segment of an executable. They are
+ * shared by every process running the executable and released once the
+ * last of them exits. Frames are loaded on first touch. */
+struct image_segment {
+    const char* elf_file;       /* the executable, as found in the cpio archive */
+    int index;                  /* program header index of the segment */
+    int refcount;
+    int npages;
+    int* frames;                /* FRAME_INVALID until loaded */
+    struct image_segment* next;
+};
+
+/**
+ * Finds (or creates) the shared frames for a segment of an executable
+ * and takes a reference to them
+ * @param elf_file the executable
+ * @param index the program header index of the segment
+ * @param npages the number of pages spanned by the segment
+ * @return the segment, or NULL if out of memory
+ */
+struct image_segment* image_segment_get(const char* elf_file, int index,
+                                        int npages);
+
+/**
+ * Takes another reference to a segment, e.g. for a cloned process
+ */
+void image_segment_ref(struct image_segment* seg);
+
+/**
+ * Drops a reference to a segment, freeing its frames with the last one
+ */
+void image_segment_put(struct image_segment* seg);
+
+#endif /* _IMAGECACHE_H_ */
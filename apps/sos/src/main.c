@@ -21,7 +21,15 @@
 #include <serial/serial.h>
 
 #include "network.h"
-#include "elf.h"
+#include "clockpage.h"
+#include "cont.h"
+#include "frametable.h"
+#include "pager.h"
+#include "perf.h"
+#include "process.h"
+#include "console.h"
+#include "syscall.h"
+#include "vm.h"
 
 #include "ut_manager/ut.h"
 #include "vmem_layout.h"
@@ -33,9 +41,6 @@
 #include <sys/debug.h>
 #include <sys/panic.h>
 
-/* This is the index where a clients syscall enpoint will
- * be stored in the clients cspace. */
-#define USER_EP_CAP          (1)
 /* To differencient between async and and sync IPC, we assign a
  * badge to the async endpoint. The badge that we receive will
  * be the bitwise 'OR' of the async endpoint badge and the badges
@@ -44,10 +49,11 @@
 /* All badged IRQs set high bet, then we use uniq bits to
  * distinguish interrupt sources */
 #define IRQ_BADGE_NETWORK (1 << 0)
+#define IRQ_BADGE_CLOCK   (1 << 1)
 
 #define TTY_NAME             CONFIG_SOS_STARTUP_APP
-#define TTY_PRIORITY         (0)
-#define TTY_EP_BADGE         (101)
+/* The interactive shell goes ahead of the processes it starts */
+#define TTY_PRIORITY         (SOS_PRIO_MAX)
 
 /* The linker will link this symbol to the start address  *
  * of an archive of attached applications.                */
@@ -56,27 +62,6 @@ extern char _cpio_archive[];
 const seL4_BootInfo* _boot_info;
 
 
-struct {
-
-    seL4_Word tcb_addr;
-    seL4_TCB tcb_cap;
-
-    seL4_Word vroot_addr;
-    seL4_ARM_PageDirectory vroot;
-
-    seL4_Word ipc_buffer_addr;
-    seL4_CPtr ipc_buffer_cap;
-
-    cspace_t *croot;
-
-} tty_test_process;
-
-
-/*
- * A dummy starting syscall
- */
-#define SOS_SYSCALL0 0
-
 seL4_CPtr _sos_ipc_ep_cap;
 seL4_CPtr _sos_interrupt_ep_cap;
 
@@ -86,66 +71,116 @@ seL4_CPtr _sos_interrupt_ep_cap;
 extern fhandle_t mnt_point;
 
 
-void handle_syscall(seL4_Word badge, int num_args) {
-    seL4_Word syscall_number;
-    seL4_CPtr reply_cap;
-
+/*
+ * Returns non zero if the faulting thread should be restarted
+ */
+int handle_vm_fault(seL4_Word badge) {
+    process_t* proc;
+    seL4_Word pc, fault_addr, ifault, fsr;
+    int write;
+    int err;
 
-    syscall_number = seL4_GetMR(0);
+    pc = seL4_GetMR(0);
+    fault_addr = seL4_GetMR(1);
+    ifault = seL4_GetMR(2);
+    fsr = seL4_GetMR(3);
+    write = !ifault && (fsr & FSR_WNR);
 
-    /* Save the caller */
-    reply_cap = cspace_save_reply_cap(cur_cspace);
-    assert(reply_cap != CSPACE_NULL);
+    dprintf(2, "vm fault at 0x%08x, pc = 0x%08x, %s\n", fault_addr, pc,
+            ifault ? "Instruction Fault" : (write ? "Write fault" : "Read fault"));
 
-    /* Process system call */
-    switch (syscall_number) {
-    case SOS_SYSCALL0:
-        dprintf(0, "syscall: thread made syscall 0!\n");
+    proc = process_lookup(badge);
+    if(proc == NULL){
+        printf("VM fault from unknown badge %d\n", badge);
+        return 0;
+    }
 
-        seL4_MessageInfo_t reply = seL4_MessageInfo_new(0, 0, 0, 1);
-        seL4_SetMR(0, 0);
-        seL4_Send(reply_cap, reply);
+    err = vm_fault(proc->as, fault_addr, write, proc->priority, proc->pid);
+    if(err == VM_FAULT_PENDING){
+        /* The pager will restart the thread */
+        return 0;
+    }else if(err){
+        /* Leave the thread blocked, we never reply to an invalid access */
+        printf("Process %d (%s): invalid access at 0x%08x, pc = 0x%08x\n",
+               proc->pid, proc->name, fault_addr, pc);
+        return 0;
+    }
 
-        break;
+    /* Restart the faulting instruction */
+    return !0;
+}
 
-    default:
-        printf("Unknown syscall %d\n", syscall_number);
-        /* we don't want to reply to an unknown syscall */
+static void handle_irq(seL4_Word badge) {
+    uint64_t start = perf_start();
 
+    if (badge & IRQ_BADGE_NETWORK) {
+        network_irq();
     }
+    if (badge & IRQ_BADGE_CLOCK) {
+        clock_page_irq();
+        /* Asynchronous NFS requests are only retransmitted from here */
+        network_timeout();
+    }
+    perf_record(SOS_PERF_IRQ, 0, start);
+}
 
-    /* Free the saved reply cap */
-    cspace_free_slot(cur_cspace, reply_cap);
+/*
+ * Handles a fault or system call. Returns non zero if the sender should
+ * be replied to with *reply.
+ */
+static int handle_message(seL4_Word badge, seL4_MessageInfo_t message,
+                          seL4_MessageInfo_t* reply) {
+    seL4_Word label = seL4_MessageInfo_get_label(message);
+
+    if(label == seL4_VMFault){
+        /* Page fault */
+        if(handle_vm_fault(badge)){
+            *reply = seL4_MessageInfo_new(0, 0, 0, 0);
+            return 1;
+        }
+    }else if(label == seL4_NoFault) {
+        /* System call */
+        if(handle_syscall(badge, seL4_MessageInfo_get_length(message) - 1)){
+            *reply = seL4_MessageInfo_new(0, 0, 0, 1);
+            return 1;
+        }
+
+    }else{
+        printf("Rootserver got an unknown message\n");
+    }
+    return 0;
 }
 
 void syscall_loop(seL4_CPtr ep) {
+    seL4_MessageInfo_t reply;
+    int have_reply = 0;
 
     while (1) {
         seL4_Word badge;
-        seL4_Word label;
         seL4_MessageInfo_t message;
 
-        message = seL4_Wait(ep, &badge);
-        label = seL4_MessageInfo_get_label(message);
-        if(badge & IRQ_EP_BADGE){
-            /* Interrupt */
-            if (badge & IRQ_BADGE_NETWORK) {
-                network_irq();
+        if(have_reply && !frame_pool_needs_refill() && !cont_runnable()){
+            /* Answer the last message and wait for the next in a single
+             * system call, which the kernel fastpath can handle */
+            message = seL4_ReplyWait(ep, reply, &badge);
+        }else{
+            if(have_reply){
+                seL4_Reply(reply);
             }
+            /* Resume work whose I/O has completed. This may reply to
+             * other callers, so our reply must already have been sent */
+            cont_run();
+            /* Prepare frames for the next faults while we have nothing to do */
+            frame_pool_refill();
+            message = seL4_Wait(ep, &badge);
+        }
 
-        }else if(label == seL4_VMFault){
-            /* Page fault */
-            dprintf(0, "vm fault at 0x%08x, pc = 0x%08x, %s\n", seL4_GetMR(1),
-                    seL4_GetMR(0),
-                    seL4_GetMR(2) ? "Instruction Fault" : "Data fault");
-
-            assert(!"Unable to handle vm faults");
-        }else if(label == seL4_NoFault) {
-            /* System call */
-            handle_syscall(badge, seL4_MessageInfo_get_length(message) - 1);
-
+        if(badge & IRQ_EP_BADGE){
+            /* Interrupt */
+            handle_irq(badge);
+            have_reply = 0;
         }else{
-            printf("Rootserver got an unknown message\n");
+            have_reply = handle_message(badge, message, &reply);
         }
     }
 }
@@ -214,109 +249,10 @@ static void print_bootinfo(const seL4_BootInfo* info) {
 }
 
 void start_first_process(char* app_name, seL4_CPtr fault_ep) {
-    int err;
-
-    seL4_Word stack_addr;
-    seL4_CPtr stack_cap;
-    seL4_CPtr user_ep_cap;
-
-    /* These required for setting up the TCB */
-    seL4_UserContext context;
-
-    /* These required for loading program sections */
-    char* elf_base;
-    unsigned long elf_size;
+    process_t* proc;
 
-    /* Create a VSpace */
-    tty_test_process.vroot_addr = ut_alloc(seL4_PageDirBits);
-    conditional_panic(!tty_test_process.vroot_addr, 
-                      "No memory for new Page Directory");
-    err = cspace_ut_retype_addr(tty_test_process.vroot_addr,
-                                seL4_ARM_PageDirectoryObject,
-                                seL4_PageDirBits,
-                                cur_cspace,
-                                &tty_test_process.vroot);
-    conditional_panic(err, "Failed to allocate page directory cap for client");
-
-    /* Create a simple 1 level CSpace */
-    tty_test_process.croot = cspace_create(1);
-    assert(tty_test_process.croot != NULL);
-
-    /* Create an IPC buffer */
-    tty_test_process.ipc_buffer_addr = ut_alloc(seL4_PageBits);
-    conditional_panic(!tty_test_process.ipc_buffer_addr, "No memory for ipc buffer");
-    err =  cspace_ut_retype_addr(tty_test_process.ipc_buffer_addr,
-                                 seL4_ARM_SmallPageObject,
-                                 seL4_PageBits,
-                                 cur_cspace,
-                                 &tty_test_process.ipc_buffer_cap);
-    conditional_panic(err, "Unable to allocate page for IPC buffer");
-
-    /* Copy the fault endpoint to the user app to enable IPC */
-    user_ep_cap = cspace_mint_cap(tty_test_process.croot,
-                                  cur_cspace,
-                                  fault_ep,
-                                  seL4_AllRights, 
-                                  seL4_CapData_Badge_new(TTY_EP_BADGE));
-    /* should be the first slot in the space, hack I know */
-    assert(user_ep_cap == 1);
-    assert(user_ep_cap == USER_EP_CAP);
-
-    /* Create a new TCB object */
-    tty_test_process.tcb_addr = ut_alloc(seL4_TCBBits);
-    conditional_panic(!tty_test_process.tcb_addr, "No memory for new TCB");
-    err =  cspace_ut_retype_addr(tty_test_process.tcb_addr,
-                                 seL4_TCBObject,
-                                 seL4_TCBBits,
-                                 cur_cspace,
-                                 &tty_test_process.tcb_cap);
-    conditional_panic(err, "Failed to create TCB");
-
-    /* Configure the TCB */
-    err = seL4_TCB_Configure(tty_test_process.tcb_cap, user_ep_cap, TTY_PRIORITY,
-                             tty_test_process.croot->root_cnode, seL4_NilData,
-                             tty_test_process.vroot, seL4_NilData, PROCESS_IPC_BUFFER,
-                             tty_test_process.ipc_buffer_cap);
-    conditional_panic(err, "Unable to configure new TCB");
-
-
-    /* parse the cpio image */
-    dprintf(1, "\nStarting \"%s\"...\n", app_name);
-    elf_base = cpio_get_file(_cpio_archive, app_name, &elf_size);
-    conditional_panic(!elf_base, "Unable to locate cpio header");
-
-    /* load the elf image */
-    err = elf_load(tty_test_process.vroot, elf_base);
-    conditional_panic(err, "Failed to load elf image");
-
-
-    /* Create a stack frame */
-    stack_addr = ut_alloc(seL4_PageBits);
-    conditional_panic(!stack_addr, "No memory for stack");
-    err =  cspace_ut_retype_addr(stack_addr,
-                                 seL4_ARM_SmallPageObject,
-                                 seL4_PageBits,
-                                 cur_cspace,
-                                 &stack_cap);
-    conditional_panic(err, "Unable to allocate page for stack");
-
-    /* Map in the stack frame for the user app */
-    err = map_page(stack_cap, tty_test_process.vroot,
-                   PROCESS_STACK_TOP - (1 << seL4_PageBits),
-                   seL4_AllRights, seL4_ARM_Default_VMAttributes);
-    conditional_panic(err, "Unable to map stack IPC buffer for user app");
-
-    /* Map in the IPC buffer for the thread */
-    err = map_page(tty_test_process.ipc_buffer_cap, tty_test_process.vroot,
-                   PROCESS_IPC_BUFFER,
-                   seL4_AllRights, seL4_ARM_Default_VMAttributes);
-    conditional_panic(err, "Unable to map IPC buffer for user app");
-
-    /* Start the new process */
-    memset(&context, 0, sizeof(context));
-    context.pc = elf_getEntryPoint(elf_base);
-    context.sp = PROCESS_STACK_TOP;
-    seL4_TCB_WriteRegisters(tty_test_process.tcb_cap, 1, 0, 2, &context);
+    proc = process_create(app_name, fault_ep, TTY_PRIORITY);
+    conditional_panic(proc == NULL, "Failed to start first process");
 }
 
 static void _sos_ipc_init(seL4_CPtr* ipc_ep, seL4_CPtr* async_ep){
@@ -385,6 +321,8 @@ static void _sos_init(seL4_CPtr* ipc_ep, seL4_CPtr* async_ep){
     conditional_panic(err, "Failed to intiialise DMA memory\n");
 
     /* Initialiase other system compenents here */
+    err = frame_table_init(low, high);
+    conditional_panic(err, "Failed to initialise the frame table\n");
 
     _sos_ipc_init(ipc_ep, async_ep);
 }
@@ -399,6 +337,7 @@ static inline seL4_CPtr badge_irq_ep(seL4_CPtr ep, seL4_Word badge) {
  * Main entry point - called by crt.
  */
 int main(void) {
+    int err;
 
     dprintf(0, "\nSOS Starting...\n");
 
@@ -407,6 +346,16 @@ int main(void) {
     /* Initialise the network hardware */
     network_init(badge_irq_ep(_sos_interrupt_ep_cap, IRQ_BADGE_NETWORK));
 
+    /* Start the clock that processes read time stamps from */
+    clock_page_init(badge_irq_ep(_sos_interrupt_ep_cap, IRQ_BADGE_CLOCK));
+
+    /* Start listening to the console */
+    console_init();
+
+    /* Initialise the pagefile now that NFS is mounted */
+    err = pager_init();
+    conditional_panic(err, "Failed to initialise the pager");
+
     /* Start the user application */
     start_first_process(TTY_NAME, _sos_ipc_ep_cap);
 
@@ -10,7 +10,10 @@
 
 #include "mapping.h"
 
+#include <assert.h>
+#include <utils/util.h>
 #include <ut_manager/ut.h>
+#include "objcache.h"
 #include "vmem_layout.h"
 
 #define verbose 0
@@ -24,46 +27,47 @@ extern const seL4_BootInfo* _boot_info;
 /**
  * Maps a page table into the root servers page directory
  * @param vaddr The virtual address of the mapping
+ * @param pt_cap On return, the cap of the new page table
+ * @param pt_addr On return, the untyped address of the new page table
  * @return 0 on success
  */
 static int 
-_map_page_table(seL4_ARM_PageDirectory pd, seL4_Word vaddr){
-    seL4_Word pt_addr;
-    seL4_ARM_PageTable pt_cap;
+_map_page_table(seL4_ARM_PageDirectory pd, seL4_Word vaddr,
+                seL4_ARM_PageTable* pt_cap, seL4_Word* pt_addr){
     int err;
 
-    /* Allocate a PT object */
-    pt_addr = ut_alloc(seL4_PageTableBits);
-    if(pt_addr == 0){
-        return !0;
-    }
-    /* Create the frame cap */
-    err =  cspace_ut_retype_addr(pt_addr, 
-                                 seL4_ARM_PageTableObject,
-                                 seL4_PageTableBits,
-                                 cur_cspace,
-                                 &pt_cap);
-    if(err){
+    /* Take a PT object */
+    *pt_cap = objcache_alloc(OBJCACHE_PT, pt_addr);
+    if(*pt_cap == CSPACE_NULL){
         return !0;
     }
     /* Tell seL4 to map the PT in for us */
-    err = seL4_ARM_PageTable_Map(pt_cap, 
+    err = seL4_ARM_PageTable_Map(*pt_cap, 
                                  pd, 
                                  vaddr, 
                                  seL4_ARM_Default_VMAttributes);
+    if(err){
+        objcache_free(OBJCACHE_PT, *pt_cap, *pt_addr);
+        *pt_cap = seL4_CapNull;
+        *pt_addr = 0;
+    }
     return err;
 }
 
 int 
-map_page(seL4_CPtr frame_cap, seL4_ARM_PageDirectory pd, seL4_Word vaddr, 
-                seL4_CapRights rights, seL4_ARM_VMAttributes attr){
+map_page_pt(seL4_CPtr frame_cap, seL4_ARM_PageDirectory pd, seL4_Word vaddr, 
+            seL4_CapRights rights, seL4_ARM_VMAttributes attr,
+            seL4_ARM_PageTable* pt_cap, seL4_Word* pt_addr){
     int err;
 
+    *pt_cap = seL4_CapNull;
+    *pt_addr = 0;
+
     /* Attempt the mapping */
     err = seL4_ARM_Page_Map(frame_cap, pd, vaddr, rights, attr);
     if(err == seL4_FailedLookup){
         /* Assume the error was because we have no page table */
-        err = _map_page_table(pd, vaddr);
+        err = _map_page_table(pd, vaddr, pt_cap, pt_addr);
         if(!err){
             /* Try the mapping again */
             err = seL4_ARM_Page_Map(frame_cap, pd, vaddr, rights, attr);
@@ -73,36 +77,114 @@ map_page(seL4_CPtr frame_cap, seL4_ARM_PageDirectory pd, seL4_Word vaddr,
     return err;
 }
 
+int 
+map_page(seL4_CPtr frame_cap, seL4_ARM_PageDirectory pd, seL4_Word vaddr, 
+                seL4_CapRights rights, seL4_ARM_VMAttributes attr){
+    seL4_ARM_PageTable pt_cap;
+    seL4_Word pt_addr;
+
+    return map_page_pt(frame_cap, pd, vaddr, rights, attr, &pt_cap, &pt_addr);
+}
+
+int
+map_frame_bits(seL4_Word vaddr, seL4_Word paddr, seL4_Word size){
+    static const int sizes[] = {MAP_SECTION_BITS, MAP_LARGE_PAGE_BITS};
+    int i;
+
+    for(i = 0; i < sizeof(sizes) / sizeof(*sizes); i++){
+        seL4_Word mask = (1 << sizes[i]) - 1;
+        if((vaddr & mask) == 0 && (paddr & mask) == 0 && size > mask){
+            return sizes[i];
+        }
+    }
+    return seL4_PageBits;
+}
+
+static seL4_Word
+_frame_type(int size_bits){
+    switch(size_bits){
+    case MAP_SECTION_BITS:
+        return seL4_ARM_SectionObject;
+    case MAP_LARGE_PAGE_BITS:
+        return seL4_ARM_LargePageObject;
+    default:
+        assert(size_bits == seL4_PageBits);
+        return seL4_ARM_SmallPageObject;
+    }
+}
+
+int
+map_large_frame(seL4_Word paddr, seL4_ARM_PageDirectory pd,
+                seL4_Word vaddr, seL4_Word size, seL4_CapRights rights,
+                seL4_ARM_VMAttributes attr, seL4_CPtr* frame_cap){
+    int bits;
+    int err;
+
+    bits = map_frame_bits(vaddr, paddr, size);
+    while(1){
+        err = cspace_ut_retype_addr(paddr, _frame_type(bits), bits,
+                                    cur_cspace, frame_cap);
+        if(!err){
+            break;
+        }
+        if(bits == seL4_PageBits){
+            return -1;
+        }
+        /* Fall back to the next size down */
+        bits = (bits == MAP_SECTION_BITS) ? MAP_LARGE_PAGE_BITS : seL4_PageBits;
+    }
+
+    err = map_page(*frame_cap, pd, vaddr, rights, attr);
+    if(err){
+        cspace_delete_cap(cur_cspace, *frame_cap);
+        return -1;
+    }
+    return bits;
+}
+
+/* Next free address for device mappings */
+static seL4_Word _device_virt = DEVICE_START;
+
 void* 
 map_device(void* paddr, int size){
-    static seL4_Word virt = DEVICE_START;
+    seL4_Word virt = _device_virt;
     seL4_Word phys = (seL4_Word)paddr;
-    seL4_Word vstart = virt;
+    seL4_Word vstart;
+    int bits;
+
+    /* Match the device's alignment so that large frames can be used */
+    bits = map_frame_bits(phys, phys, size);
+    virt = ROUND_UP(virt, BIT(bits));
+    vstart = virt;
 
     dprintf(1, "Mapping device memory 0x%x -> 0x%x (0x%x bytes)\n",
                 phys, vstart, size);
     while(virt - vstart < size){
-        seL4_Error err;
         seL4_ARM_Page frame_cap;
-        /* Retype the untype to a frame */
-        err = cspace_ut_retype_addr(phys,
-                                    seL4_ARM_SmallPageObject,
-                                    seL4_PageBits,
-                                    cur_cspace,
-                                    &frame_cap);
-        conditional_panic(err, "Unable to retype device memory");
-        /* Map in the page */
-        err = map_page(frame_cap, 
-                       seL4_CapInitThreadPD, 
-                       virt, 
-                       seL4_AllRights,
-                       0);
-        conditional_panic(err, "Unable to map device");
+        /* Retype the untyped to frames and map them in */
+        bits = map_large_frame(phys, seL4_CapInitThreadPD, virt,
+                               size - (virt - vstart), seL4_AllRights, 0,
+                               &frame_cap);
+        conditional_panic(bits < 0, "Unable to map device");
         /* Next address */
-        phys += (1 << seL4_PageBits);
-        virt += (1 << seL4_PageBits);
+        phys += BIT(bits);
+        virt += BIT(bits);
     }
+    _device_virt = virt;
     return (void*)vstart;
 }
 
+void*
+map_device_page(void* paddr, seL4_ARM_Page* frame_cap){
+    seL4_Word vaddr = _device_virt;
+    int err;
 
+    dprintf(1, "Mapping device page 0x%x -> 0x%x\n", (seL4_Word)paddr, vaddr);
+    err = cspace_ut_retype_addr((seL4_Word)paddr, seL4_ARM_SmallPageObject,
+                                seL4_PageBits, cur_cspace, frame_cap);
+    conditional_panic(err, "Unable to retype device page");
+    err = map_page(*frame_cap, seL4_CapInitThreadPD, vaddr, seL4_AllRights, 0);
+    conditional_panic(err, "Unable to map device page");
+    _device_virt += BIT(seL4_PageBits);
+    return (void*)vaddr;
+}
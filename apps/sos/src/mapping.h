@@ -27,9 +27,70 @@
 int map_page(seL4_CPtr frame_cap, seL4_ARM_PageDirectory pd, seL4_Word vaddr, 
                 seL4_CapRights rights, seL4_ARM_VMAttributes attr);
  
+ /**
+ * Maps a page into a page table, reporting any 2nd level table that
+ * had to be created so that the caller can release it later.
+ *
+ * @param frame_cap a capbility to the page to be mapped
+ * @param pd A capability to the page directory to map to
+ * @param vaddr The virtual address for the mapping
+ * @param rights The access rights for the mapping
+ * @param attr The VM attributes to use for the mapping
+ * @param pt_cap On return, the cap to a newly created page table or
+ *               seL4_CapNull if no page table was created. A page table
+ *               may be returned even if the page mapping itself fails
+ * @param pt_addr On return, the untyped address of the new page table
+ * @return 0 on success
+ */
+int map_page_pt(seL4_CPtr frame_cap, seL4_ARM_PageDirectory pd, seL4_Word vaddr, 
+                seL4_CapRights rights, seL4_ARM_VMAttributes attr,
+                seL4_ARM_PageTable* pt_cap, seL4_Word* pt_addr);
+
+ /**
+ * Frame sizes, other than seL4_PageBits, supported by the ARM short
+ * descriptor page table format. A large page occupies 16 consecutive
+ * entries of a 2nd level table, and a section is mapped directly by
+ * the page directory.
+ */
+#define MAP_LARGE_PAGE_BITS (16)
+#define MAP_SECTION_BITS    (20)
+
+ /**
+ * Chooses the largest frame with which vaddr can be mapped to paddr
+ * without mapping anything at or beyond vaddr + size
+ *
+ * @param vaddr The virtual address for the mapping
+ * @param paddr The physical address to be mapped
+ * @param size The number of bytes from vaddr that may be mapped
+ * @return seL4_PageBits, MAP_LARGE_PAGE_BITS or MAP_SECTION_BITS
+ */
+int map_frame_bits(seL4_Word vaddr, seL4_Word paddr, seL4_Word size);
+
+ /**
+ * Retypes the memory at paddr into the largest frame allowed by
+ * map_frame_bits and maps it. Smaller frames are tried if the memory
+ * cannot be retyped into a larger one, e.g. because the untyped that
+ * covers it is too small. Used for device and SOS mappings only; pages
+ * of process regions are always 4K frames from the frame table, which
+ * is what the pager evicts and writes to the pagefile.
+ *
+ * @param paddr The physical address to be mapped
+ * @param pd A capability to the page directory to map to
+ * @param vaddr The virtual address for the mapping
+ * @param size The number of bytes from vaddr that may be mapped
+ * @param rights The access rights for the mapping
+ * @param attr The VM attributes to use for the mapping
+ * @param frame_cap On return, the cap to the new frame
+ * @return the size of the frame in bits, or -1 on failure
+ */
+int map_large_frame(seL4_Word paddr, seL4_ARM_PageDirectory pd,
+                    seL4_Word vaddr, seL4_Word size, seL4_CapRights rights,
+                    seL4_ARM_VMAttributes attr, seL4_CPtr* frame_cap);
+
  /**
  * Maps a device to virtual memory
- * A 2nd level table will be created if required
+ * A 2nd level table will be created if required. Large frames are used
+ * where the device's alignment and size allow.
  *
  * @param paddr the physical address of the device
  * @param size the number of bytes that this device occupies
@@ -37,4 +98,14 @@ int map_page(seL4_CPtr frame_cap, seL4_ARM_PageDirectory pd, seL4_Word vaddr,
  */
 void* map_device(void* paddr, int size);
 
+ /**
+ * Maps a single page of a device to virtual memory, keeping the frame
+ * cap so that the page can also be mapped elsewhere
+ *
+ * @param paddr the physical address of the page
+ * @param frame_cap On return, the cap to the frame
+ * @return The new virtual address of the page
+ */
+void* map_device_page(void* paddr, seL4_ARM_Page* frame_cap);
+
 #endif /* _MAPPING_H_ */
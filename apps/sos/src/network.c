@@ -33,6 +33,7 @@
 #include <ethdrivers/imx6.h>
 #include <cspace/cspace.h>
 
+#include "clockpage.h"
 #include "dma.h"
 #include "mapping.h"
 #include "ut_manager/ut.h"
@@ -53,6 +54,9 @@
 #define ARP_PRIME_TIMEOUT_MS     1000
 #define ARP_PRIME_RETRY_DELAY_MS   10
 
+/* How often nfs_timeout expects to be called */
+#define NFS_TIMEOUT_MS            100
+
 extern const seL4_BootInfo* _boot_info;
 
 static struct net_irq {
@@ -64,6 +68,9 @@ static seL4_CPtr _irq_ep;
 
 fhandle_t mnt_point = { { 0 } };
 
+/* When nfs_timeout was last run, in microseconds since boot */
+static uint64_t _last_timeout = 0;
+
 lwip_iface_t *lwip_iface;
 
 /*******************
@@ -92,6 +99,19 @@ sos_usleep(int usecs) {
 
     /* Handle pending network traffic */
     ethif_lwip_poll(lwip_iface);
+    network_timeout();
+}
+
+void
+network_timeout(void){
+    uint64_t now = clock_page_time();
+
+    /* If we were held up, catch up with a single call rather than
+     * sending a burst of retransmissions */
+    if(now - _last_timeout >= NFS_TIMEOUT_MS * 1000){
+        _last_timeout = now;
+        nfs_timeout();
+    }
 }
 
 /*******************
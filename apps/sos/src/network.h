@@ -36,4 +36,16 @@ extern int dma_init(seL4_Word paddr, int sizebits);
  */
 extern void network_irq(void);
 
+/**
+ * Retransmits NFS requests whose replies may have been lost. It may be
+ * called at any rate; nfs_timeout is run at most once every 100ms.
+ */
+extern void network_timeout(void);
+
+/**
+ * Busy waits for (roughly) the given time while polling the network
+ * @param[in] usecs    The number of microseconds to wait
+ */
+extern void sos_usleep(int usecs);
+
 #endif
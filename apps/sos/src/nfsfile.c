@@ -0,0 +1,249 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Files on the NFS mount. Every operation is a single NFS request that
+ * completes in a callback, so the caller's reply cap travels with the
+ * request. Data moves directly between NFS and memory the caller shares
+ * with SOS, which is always resident.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <nfs/nfs.h>
+#include <sos_syscall.h>
+#include <utils/util.h>
+
+#include "network.h"
+#include "nfsfile.h"
+#include "syscall.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+/* An NFS request on behalf of a process */
+struct nfsfile_req {
+    struct file* file;          /* NULL while opening */
+    syscall_caller_t caller;
+    int mode;                   /* open only */
+    char path[SOS_PATH_MAX];    /* open only */
+    char* data;                 /* read only */
+    size_t offset;
+    size_t count;
+};
+
+static const struct file_ops _nfsfile_ops;
+
+/*
+ * Replies to the process that made a request and releases the request
+ */
+static void
+_nfsfile_done(struct nfsfile_req* req, seL4_Word ret){
+    syscall_reply(req->caller, ret);
+    if(req->file != NULL){
+        file_put(req->file);
+    }
+    free(req);
+}
+
+/*************************
+ *** Open ***
+ *************************/
+
+static void
+_nfsfile_opened(struct nfsfile_req* req, fhandle_t* fh, fattr_t* fattr){
+    process_t* proc = process_lookup(req->caller.pid);
+    struct file* file;
+
+    if(proc == NULL){
+        _nfsfile_done(req, -1);
+        return;
+    }
+    file = file_alloc(&_nfsfile_ops, req->mode);
+    if(file == NULL){
+        _nfsfile_done(req, -1);
+        return;
+    }
+    /* Kept with the open file so I/O goes straight to the server */
+    file->fh = *fh;
+    file->attr = *fattr;
+
+    syscall_reply(req->caller, file_install(proc, file));
+    free(req);
+}
+
+static void
+_nfsfile_create_cb(uintptr_t token, enum nfs_stat status,
+                   fhandle_t* fh, fattr_t* fattr){
+    struct nfsfile_req* req = (struct nfsfile_req*)token;
+
+    if(status != NFS_OK){
+        dprintf(0, "nfsfile: unable to create %s (%d)\n", req->path, status);
+        _nfsfile_done(req, -1);
+        return;
+    }
+    _nfsfile_opened(req, fh, fattr);
+}
+
+static void
+_nfsfile_lookup_cb(uintptr_t token, enum nfs_stat status,
+                   fhandle_t* fh, fattr_t* fattr){
+    struct nfsfile_req* req = (struct nfsfile_req*)token;
+    sattr_t sattr;
+
+    if(status == NFS_OK){
+        _nfsfile_opened(req, fh, fattr);
+        return;
+    }
+    if(status != NFSERR_NOENT || req->mode == SOS_O_RDONLY){
+        _nfsfile_done(req, -1);
+        return;
+    }
+
+    sattr.mode = 0666;
+    sattr.uid = (uint32_t)-1;
+    sattr.gid = (uint32_t)-1;
+    sattr.size = 0;
+    sattr.atime.seconds = (uint32_t)-1;
+    sattr.atime.useconds = (uint32_t)-1;
+    sattr.mtime.seconds = (uint32_t)-1;
+    sattr.mtime.useconds = (uint32_t)-1;
+    if(nfs_create(&mnt_point, req->path, &sattr, _nfsfile_create_cb,
+                  (uintptr_t)req) != RPC_OK){
+        _nfsfile_done(req, -1);
+    }
+}
+
+int
+nfsfile_open(syscall_ctx_t* ctx, process_t* proc, const char* path,
+             int mode){
+    struct nfsfile_req* req;
+
+    req = malloc(sizeof(*req));
+    if(req == NULL){
+        return -1;
+    }
+    memset(req, 0, sizeof(*req));
+    req->mode = mode;
+    strncpy(req->path, path, SOS_PATH_MAX - 1);
+
+    if(nfs_lookup(&mnt_point, req->path, _nfsfile_lookup_cb,
+                  (uintptr_t)req) != RPC_OK){
+        free(req);
+        return -1;
+    }
+    /* Nothing can complete until we next poll the network */
+    req->caller = syscall_defer(ctx);
+    return 0;
+}
+
+/*************************
+ *** Read and write ***
+ *************************/
+
+static struct nfsfile_req*
+_nfsfile_req_new(struct file* file, process_t* proc, size_t count){
+    struct nfsfile_req* req = malloc(sizeof(*req));
+    if(req == NULL){
+        return NULL;
+    }
+    file_ref(file);
+    req->file = file;
+    req->offset = file->offset;
+    req->count = count;
+    return req;
+}
+
+/*
+ * Releases a request that could not be sent
+ */
+static void
+_nfsfile_req_free(struct nfsfile_req* req){
+    file_put(req->file);
+    free(req);
+}
+
+static void
+_nfsfile_read_cb(uintptr_t token, enum nfs_stat status,
+                 fattr_t* fattr, int count, void* data){
+    struct nfsfile_req* req = (struct nfsfile_req*)token;
+    process_t* proc = process_lookup(req->caller.pid);
+    int ret = -1;
+
+    if(proc != NULL && status == NFS_OK && count >= 0 && count <= req->count){
+        memcpy(req->data, data, count);
+        req->file->offset = req->offset + count;
+        req->file->attr = *fattr;
+        ret = count;
+    }
+    _nfsfile_done(req, ret);
+}
+
+static int
+_nfsfile_read(struct file* file, syscall_ctx_t* ctx, process_t* proc,
+              char* data, size_t nbyte){
+    struct nfsfile_req* req;
+    size_t count = MIN(nbyte, NFSFILE_IO_MAX);
+
+    req = _nfsfile_req_new(file, proc, count);
+    if(req == NULL){
+        return -1;
+    }
+    req->data = data;
+    if(nfs_read(&file->fh, req->offset, count, _nfsfile_read_cb,
+                (uintptr_t)req) != RPC_OK){
+        _nfsfile_req_free(req);
+        return -1;
+    }
+    req->caller = syscall_defer(ctx);
+    return 0;
+}
+
+static void
+_nfsfile_write_cb(uintptr_t token, enum nfs_stat status,
+                  fattr_t* fattr, int count){
+    struct nfsfile_req* req = (struct nfsfile_req*)token;
+
+    if(status != NFS_OK || count < 0){
+        _nfsfile_done(req, -1);
+        return;
+    }
+    req->file->offset = req->offset + count;
+    req->file->attr = *fattr;
+    _nfsfile_done(req, count);
+}
+
+static int
+_nfsfile_write(struct file* file, syscall_ctx_t* ctx, process_t* proc,
+               char* data, size_t nbyte){
+    struct nfsfile_req* req;
+    size_t count = MIN(nbyte, NFSFILE_IO_MAX);
+
+    req = _nfsfile_req_new(file, proc, count);
+    if(req == NULL){
+        return -1;
+    }
+    /* nfs_write copies the data out before returning */
+    if(nfs_write(&file->fh, req->offset, count, data,
+                 _nfsfile_write_cb, (uintptr_t)req) != RPC_OK){
+        _nfsfile_req_free(req);
+        return -1;
+    }
+    req->caller = syscall_defer(ctx);
+    return 0;
+}
+
+static const struct file_ops _nfsfile_ops = {
+    .read = _nfsfile_read,
+    .write = _nfsfile_write,
+};
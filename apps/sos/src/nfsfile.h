@@ -0,0 +1,29 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _NFSFILE_H_
+#define _NFSFILE_H_
+
+#include "file.h"
+
+/* Most bytes moved by a single read or write. Replies must fit in a
+ * single UDP packet */
+#define NFSFILE_IO_MAX      (1024)
+
+/**
+ * Opens a file on the NFS mount, creating it if it does not exist and
+ * the mode allows writing. Defers the system call, which completes
+ * once the file has been looked up.
+ * @return -1 if the lookup could not be sent
+ */
+int nfsfile_open(syscall_ctx_t* ctx, process_t* proc, const char* path,
+                 int mode);
+
+#endif /* _NFSFILE_H_ */
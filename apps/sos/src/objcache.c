@@ -0,0 +1,140 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Caches of ready made kernel objects. Creating a process, or a page
+ * table for one, would otherwise take an allocation of untyped memory and
+ * a retype each time, and tearing it down a delete and a free. Objects
+ * are instead created a batch at a time, with one retype of one block of
+ * untyped memory into a range of slots, and recycled into their cache
+ * when released.
+ */
+#include <assert.h>
+
+#include <cspace/cspace.h>
+
+#include "objcache.h"
+#include "ut_manager/ut.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+/* Objects created at once when a cache is empty */
+#define OBJCACHE_BATCH_BITS (2)
+#define OBJCACHE_BATCH      (1 << OBJCACHE_BATCH_BITS)
+/* Most objects kept in a cache */
+#define OBJCACHE_SIZE       (16)
+
+struct objcache_obj {
+    seL4_CPtr cap;
+    seL4_Word addr;
+};
+
+struct objcache {
+    seL4_Word type;             /* of the seL4 object */
+    int sizebits;
+    int count;
+    struct objcache_obj objs[OBJCACHE_SIZE];
+};
+
+static struct objcache _caches[OBJCACHE_TYPES] = {
+    [OBJCACHE_TCB] = { .type = seL4_TCBObject,
+                       .sizebits = seL4_TCBBits },
+    [OBJCACHE_EP]  = { .type = seL4_EndpointObject,
+                       .sizebits = seL4_EndpointBits },
+    [OBJCACHE_AEP] = { .type = seL4_AsyncEndpointObject,
+                       .sizebits = seL4_EndpointBits },
+    [OBJCACHE_PT]  = { .type = seL4_ARM_PageTableObject,
+                       .sizebits = seL4_PageTableBits },
+    [OBJCACHE_PD]  = { .type = seL4_ARM_PageDirectoryObject,
+                       .sizebits = seL4_PageDirBits },
+};
+
+/*
+ * Creates a batch of objects, or a single one if there is no block of
+ * untyped memory large enough for a batch
+ */
+static void
+_objcache_fill(struct objcache* c){
+    seL4_Word block;
+    seL4_CPtr first;
+    int n = OBJCACHE_BATCH;
+    int err;
+    int i;
+
+    block = ut_alloc(c->sizebits + OBJCACHE_BATCH_BITS);
+    if(block != 0){
+        err = cspace_ut_retype_addrs(block, c->type, c->sizebits,
+                                     cur_cspace, n, &first);
+        if(err){
+            ut_free(block, c->sizebits + OBJCACHE_BATCH_BITS);
+            block = 0;
+        }
+    }
+    if(block == 0){
+        n = 1;
+        block = ut_alloc(c->sizebits);
+        if(block == 0){
+            return;
+        }
+        err = cspace_ut_retype_addr(block, c->type, c->sizebits,
+                                    cur_cspace, &first);
+        if(err){
+            ut_free(block, c->sizebits);
+            return;
+        }
+    }
+
+    /* Objects are freed one at a time, which the untyped allocator and
+     * cspace both allow */
+    for(i = 0; i < n; i++){
+        c->objs[c->count].cap = first + i;
+        c->objs[c->count].addr = block + (i << c->sizebits);
+        c->count++;
+    }
+}
+
+seL4_CPtr
+objcache_alloc(enum objcache_type type, seL4_Word* addr){
+    struct objcache* c;
+    struct objcache_obj* obj;
+
+    assert(type >= 0 && type < OBJCACHE_TYPES);
+    c = &_caches[type];
+    if(c->count == 0){
+        _objcache_fill(c);
+        if(c->count == 0){
+            *addr = 0;
+            return CSPACE_NULL;
+        }
+    }
+
+    obj = &c->objs[--c->count];
+    *addr = obj->addr;
+    return obj->cap;
+}
+
+void
+objcache_free(enum objcache_type type, seL4_CPtr cap, seL4_Word addr){
+    struct objcache* c;
+
+    assert(type >= 0 && type < OBJCACHE_TYPES);
+    c = &_caches[type];
+    if(c->count < OBJCACHE_SIZE){
+        cspace_recycle_cap(cur_cspace, cap);
+        c->objs[c->count].cap = cap;
+        c->objs[c->count].addr = addr;
+        c->count++;
+    }else{
+        cspace_delete_cap(cur_cspace, cap);
+        ut_free(addr, c->sizebits);
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _OBJCACHE_H_
+#define _OBJCACHE_H_
+
+#include <sel4/sel4.h>
+
+/* The kernel objects SOS keeps ready made */
+enum objcache_type {
+    OBJCACHE_TCB,
+    OBJCACHE_EP,
+    OBJCACHE_AEP,
+    OBJCACHE_PT,
+    OBJCACHE_PD,
+    OBJCACHE_TYPES
+};
+
+/**
+ * Takes a kernel object of the given type, creating more if none are
+ * cached. The cap is in SOS's cspace.
+ * @param addr on return, the untyped address of the object, which must be
+ *        passed back to objcache_free
+ * @return the cap to the object, or CSPACE_NULL if out of memory
+ */
+seL4_CPtr objcache_alloc(enum objcache_type type, seL4_Word* addr);
+
+/**
+ * Returns a kernel object to its cache. The object is recycled, which
+ * revokes any caps derived from this one and returns it to the state it
+ * was created in. The cap is deleted and its memory freed instead if the
+ * cache is full.
+ */
+void objcache_free(enum objcache_type type, seL4_CPtr cap, seL4_Word addr);
+
+#endif /* _OBJCACHE_H_ */
@@ -0,0 +1,586 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Moves pages between frames and a pagefile on the NFS mount. Each page
+ * occupies one page sized slot of the file.
+ *
+ * A page does not fit in a single NFS request, so every page operation
+ * is split into chunks. Chunks wait in a queue and are sent from there
+ * while fewer than PAGER_MAX_INFLIGHT requests are outstanding. Reads are
+ * always sent before writes: a page-in has a process blocked on it while
+ * a writeback only refills the free frame pool. Reads for higher priority
+ * processes go first. A chunk is bounded by the size of libnfs's request
+ * packets, so a page always takes four requests.
+ *
+ * A page read back in keeps its slot, which the frame table releases when
+ * the page is first written to. Clean pages are therefore evicted without
+ * any I/O at all.
+ *
+ * Slots are handed out from groups of PAGER_CLUSTER. A cluster is written
+ * to an empty group, while single slots come from partly used groups
+ * first so that empty ones are left for clusters.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cspace/cspace.h>
+#include <nfs/nfs.h>
+#include <utils/util.h>
+
+#include "pager.h"
+#include "cont.h"
+#include "frametable.h"
+#include "network.h"
+#include "vm.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+#define PAGESIZE              (1 << (seL4_PageBits))
+
+/* How often to poll the network while waiting for a reply */
+#define PAGER_POLL_MS         (10)
+/* Bytes per request. Replies must fit in a single UDP packet */
+#define PAGER_CHUNK           (1024)
+/* Requests outstanding at once. Bounded by lwIP's packet memory */
+#define PAGER_MAX_INFLIGHT    (6)
+
+#define SLOT_GROUP            (PAGER_CLUSTER)
+#define SLOT_NGROUPS          (PAGEFILE_MAX_PAGES / SLOT_GROUP)
+#define GROUP_FULL            ((uint32_t)(BIT(SLOT_GROUP) - 1))
+
+/* A page being moved to or from the pagefile */
+struct pager_op {
+    int write;
+    int prio;                   /* of the process waiting, reads only */
+    int frame;
+    pte_t* pte;
+    int slot;
+    int remaining;              /* chunks not yet completed */
+    int err;
+    pager_cb_t cb;
+    uintptr_t token;
+};
+
+/* A single NFS request of a page operation */
+struct pager_chunk {
+    struct pager_op* op;
+    int pos;
+    int count;
+    struct pager_chunk* next;
+};
+
+struct chunk_queue {
+    struct pager_chunk* head;
+    struct pager_chunk* tail;
+};
+
+/* Used for synchronous requests */
+struct pager_io {
+    volatile int complete;
+    enum nfs_stat status;
+    fhandle_t* fh;
+};
+
+static fhandle_t _pagefile;
+static int _pager_ready = 0;
+
+/* A group of slots and its place on the empty or partly used list */
+struct slot_group {
+    uint32_t used;              /* a bit for each slot in use */
+    int prev;
+    int next;
+};
+
+static struct slot_group _groups[SLOT_NGROUPS];
+/* References to each slot beyond the first, from pages that were shared
+ * copy on write when they were evicted */
+static uint8_t _slot_shares[PAGEFILE_MAX_PAGES];
+static int _empty_groups = -1;
+static int _partial_groups = -1;
+
+static struct chunk_queue _reads;
+static struct chunk_queue _writes;
+static int _inflight = 0;
+
+static void _pager_pump(void);
+
+/*************************
+ *** Pagefile slots ***
+ *************************/
+
+/* The list a group belongs on, if any */
+static int*
+_group_list(uint32_t used){
+    if(used == 0){
+        return &_empty_groups;
+    }
+    return (used == GROUP_FULL) ? NULL : &_partial_groups;
+}
+
+static void
+_group_set(int g, uint32_t used){
+    struct slot_group* grp = &_groups[g];
+    int* from = _group_list(grp->used);
+    int* to = _group_list(used);
+
+    grp->used = used;
+    if(from == to){
+        return;
+    }
+    if(from != NULL){
+        if(grp->prev >= 0){
+            _groups[grp->prev].next = grp->next;
+        }else{
+            *from = grp->next;
+        }
+        if(grp->next >= 0){
+            _groups[grp->next].prev = grp->prev;
+        }
+    }
+    if(to != NULL){
+        grp->prev = -1;
+        grp->next = *to;
+        if(*to >= 0){
+            _groups[*to].prev = g;
+        }
+        *to = g;
+    }
+}
+
+static void
+_slot_init(void){
+    int g;
+    for(g = SLOT_NGROUPS - 1; g >= 0; g--){
+        /* Appears full, so that it moves onto the empty list */
+        _groups[g].used = GROUP_FULL;
+        _group_set(g, 0);
+    }
+}
+
+static int
+_slot_alloc(void){
+    int g = (_partial_groups >= 0) ? _partial_groups : _empty_groups;
+    int bit;
+
+    if(g < 0){
+        return -1;
+    }
+    bit = CTZ(~_groups[g].used);
+    _group_set(g, _groups[g].used | BIT(bit));
+    return g * SLOT_GROUP + bit;
+}
+
+/*
+ * Finds n contiguous free slots so that a cluster is written
+ * sequentially. Returns the first slot or -1.
+ */
+static int
+_slot_alloc_run(int n){
+    int g = _empty_groups;
+
+    assert(n > 0 && n <= SLOT_GROUP);
+    if(g < 0){
+        return -1;
+    }
+    _group_set(g, GROUP_FULL >> (SLOT_GROUP - n));
+    return g * SLOT_GROUP;
+}
+
+void
+pager_ref_slot(int slot){
+    assert(slot >= 0 && slot < PAGEFILE_MAX_PAGES);
+    assert(_groups[slot / SLOT_GROUP].used & BIT(slot % SLOT_GROUP));
+    assert(_slot_shares[slot] < UINT8_MAX);
+    _slot_shares[slot]++;
+}
+
+void
+pager_free_slot(int slot){
+    int g = slot / SLOT_GROUP;
+    uint32_t bit = BIT(slot % SLOT_GROUP);
+
+    assert(slot >= 0 && slot < PAGEFILE_MAX_PAGES);
+    assert(_groups[g].used & bit);
+    if(_slot_shares[slot] > 0){
+        _slot_shares[slot]--;
+        return;
+    }
+    _group_set(g, _groups[g].used & ~bit);
+}
+
+/*************************
+ *** Chunk queues ***
+ *************************/
+
+static void
+_queue_push(struct chunk_queue* q, struct pager_chunk* c){
+    c->next = NULL;
+    if(q->tail == NULL){
+        q->head = c;
+    }else{
+        q->tail->next = c;
+    }
+    q->tail = c;
+}
+
+static void
+_queue_push_front(struct chunk_queue* q, struct pager_chunk* c){
+    c->next = q->head;
+    q->head = c;
+    if(q->tail == NULL){
+        q->tail = c;
+    }
+}
+
+/*
+ * Queues a chunk behind those of the same or higher priority
+ */
+static void
+_queue_push_prio(struct chunk_queue* q, struct pager_chunk* c){
+    struct pager_chunk** pp = &q->head;
+
+    if(q->tail == NULL || q->tail->op->prio >= c->op->prio){
+        _queue_push(q, c);
+        return;
+    }
+    while((*pp)->op->prio >= c->op->prio){
+        pp = &(*pp)->next;
+    }
+    c->next = *pp;
+    *pp = c;
+}
+
+static struct pager_chunk*
+_queue_pop(struct chunk_queue* q){
+    struct pager_chunk* c = q->head;
+    if(c != NULL){
+        q->head = c->next;
+        if(q->head == NULL){
+            q->tail = NULL;
+        }
+    }
+    return c;
+}
+
+/*************************
+ *** Page operations ***
+ *************************/
+
+static void
+_pager_op_done(struct pager_op* op){
+    pte_t* pte = op->pte;
+
+    if(op->write){
+        if(!op->err){
+            /* The frame now belongs to whoever evicted it */
+            cspace_delete_cap(cur_cspace, pte->cap);
+            pte->cap = seL4_CapNull;
+            pte->frame = op->slot;
+            pte->swapped = 1;
+        }else{
+            pager_free_slot(op->slot);
+        }
+    }else if(!op->err){
+        /* The slot stays valid until the page is written to */
+        frame_set_slot(op->frame, op->slot);
+        pte->swapped = 0;
+        /* The page may hold code */
+        frame_sync_icache(op->frame);
+    }
+    pte->busy = 0;
+
+    dprintf(1, "Page %s of frame %d (slot %d) %s\n",
+            op->write ? "out" : "in", op->frame, op->slot,
+            op->err ? "failed" : "done");
+    op->cb(op->token, op->err);
+    free(op);
+
+    /* Faults and continuations may have been waiting for this page */
+    vm_retry_blocked();
+    cont_wake_all();
+}
+
+static void
+_pager_chunk_done(struct pager_chunk* c){
+    struct pager_op* op = c->op;
+    free(c);
+    if(--op->remaining == 0){
+        _pager_op_done(op);
+    }
+}
+
+static int
+_pager_queue_op(struct pager_op* op){
+    struct chunk_queue* q = op->write ? &_writes : &_reads;
+    int pos;
+
+    op->remaining = 0;
+    for(pos = 0; pos < PAGESIZE; pos += PAGER_CHUNK){
+        struct pager_chunk* c = malloc(sizeof(*c));
+        if(c == NULL){
+            /* Let the chunks already queued finish the op */
+            op->err = 1;
+            break;
+        }
+        c->op = op;
+        c->pos = pos;
+        c->count = MIN(PAGER_CHUNK, PAGESIZE - pos);
+        _queue_push_prio(q, c);
+        op->remaining++;
+    }
+    return op->remaining == 0;
+}
+
+/*************************
+ *** NFS requests ***
+ *************************/
+
+static void
+_pager_write_cb(uintptr_t token, enum nfs_stat status,
+                fattr_t* fattr, int count){
+    struct pager_chunk* c = (struct pager_chunk*)token;
+
+    _inflight--;
+    if(status != NFS_OK || count <= 0){
+        c->op->err = 1;
+    }else if(count < c->count){
+        /* Short write, send the rest before anything else */
+        c->pos += count;
+        c->count -= count;
+        _queue_push_front(&_writes, c);
+        _pager_pump();
+        return;
+    }
+    _pager_chunk_done(c);
+    _pager_pump();
+}
+
+static void
+_pager_read_cb(uintptr_t token, enum nfs_stat status,
+               fattr_t* fattr, int count, void* data){
+    struct pager_chunk* c = (struct pager_chunk*)token;
+
+    _inflight--;
+    if(status != NFS_OK || count <= 0 || count > c->count){
+        c->op->err = 1;
+    }else{
+        char* frame_data = frame_vaddr(c->op->frame);
+        memcpy(frame_data + c->pos, data, count);
+        if(count < c->count){
+            c->pos += count;
+            c->count -= count;
+            _queue_push_front(&_reads, c);
+            _pager_pump();
+            return;
+        }
+    }
+    _pager_chunk_done(c);
+    _pager_pump();
+}
+
+static enum rpc_stat
+_pager_send(struct pager_chunk* c){
+    struct pager_op* op = c->op;
+    int offset = op->slot * PAGESIZE + c->pos;
+    enum rpc_stat err;
+
+    if(op->write){
+        /* nfs_write copies the data out before returning */
+        char* data = frame_vaddr(op->frame);
+        err = nfs_write(&_pagefile, offset, c->count, data + c->pos,
+                        _pager_write_cb, (uintptr_t)c);
+    }else{
+        err = nfs_read(&_pagefile, offset, c->count,
+                       _pager_read_cb, (uintptr_t)c);
+    }
+    return err;
+}
+
+/*
+ * Sends queued chunks until the in flight limit is reached
+ */
+static void
+_pager_pump(void){
+    while(_inflight < PAGER_MAX_INFLIGHT){
+        struct chunk_queue* q;
+        struct pager_chunk* c;
+        enum rpc_stat err;
+
+        q = (_reads.head != NULL) ? &_reads : &_writes;
+        c = _queue_pop(q);
+        if(c == NULL){
+            return;
+        }
+        if(c->op->err){
+            /* Another chunk of this op failed, don't bother */
+            _pager_chunk_done(c);
+            continue;
+        }
+        err = _pager_send(c);
+        if(err == RPC_OK){
+            _inflight++;
+        }else if(err == RPCERR_NOBUF && _inflight > 0){
+            /* Out of packet buffers, retry as replies free them */
+            _queue_push_front(q, c);
+            return;
+        }else{
+            c->op->err = 1;
+            _pager_chunk_done(c);
+        }
+    }
+}
+
+/*************************
+ *** Interface ***
+ *************************/
+
+void
+pager_wait(volatile int* done){
+    /* Polling also retransmits lost requests */
+    while(!*done){
+        sos_usleep(PAGER_POLL_MS * 1000);
+    }
+}
+
+static void
+_pager_create_cb(uintptr_t token, enum nfs_stat status,
+                 fhandle_t* fh, fattr_t* fattr){
+    struct pager_io* io = (struct pager_io*)token;
+    io->status = status;
+    if(status == NFS_OK){
+        *io->fh = *fh;
+    }
+    io->complete = 1;
+}
+
+int
+pager_init(void){
+    struct pager_io io;
+    sattr_t sattr;
+    enum rpc_stat err;
+
+    /* Start from an empty pagefile */
+    sattr.mode = 0600;
+    sattr.uid = (uint32_t)-1;
+    sattr.gid = (uint32_t)-1;
+    sattr.size = 0;
+    sattr.atime.seconds = (uint32_t)-1;
+    sattr.atime.useconds = (uint32_t)-1;
+    sattr.mtime.seconds = (uint32_t)-1;
+    sattr.mtime.useconds = (uint32_t)-1;
+
+    _slot_init();
+
+    memset(&io, 0, sizeof(io));
+    io.fh = &_pagefile;
+    err = nfs_create(&mnt_point, PAGEFILE_NAME, &sattr, _pager_create_cb,
+                     (uintptr_t)&io);
+    if(err != RPC_OK){
+        return !0;
+    }
+    pager_wait(&io.complete);
+    if(io.status != NFS_OK){
+        dprintf(0, "Unable to create pagefile (%d)\n", io.status);
+        return !0;
+    }
+
+    _pager_ready = 1;
+    return 0;
+}
+
+int
+pager_pageout(int nframes, const int* frames, pte_t** ptes, pager_cb_t cb){
+    int base;
+    int i;
+
+    if(!_pager_ready || nframes == 0){
+        return 0;
+    }
+
+    /* Fall back to scattered slots if the pagefile is fragmented */
+    base = _slot_alloc_run(nframes);
+    for(i = 0; i < nframes; i++){
+        struct pager_op* op;
+        int slot;
+
+        assert(ptes[i]->cap != seL4_CapNull && !ptes[i]->mapped);
+        assert(frame_slot(frames[i]) < 0);
+        slot = (base >= 0) ? base + i : _slot_alloc();
+        if(slot < 0){
+            dprintf(0, "Pagefile is full\n");
+            break;
+        }
+        op = malloc(sizeof(*op));
+        if(op == NULL){
+            pager_free_slot(slot);
+            break;
+        }
+        op->write = 1;
+        op->prio = 0;
+        op->frame = frames[i];
+        op->pte = ptes[i];
+        op->slot = slot;
+        op->err = 0;
+        op->cb = cb;
+        op->token = (uintptr_t)frames[i];
+        ptes[i]->busy = 1;
+        if(_pager_queue_op(op)){
+            ptes[i]->busy = 0;
+            pager_free_slot(slot);
+            free(op);
+            break;
+        }
+    }
+    /* Release any slots reserved for frames we gave up on */
+    if(base >= 0){
+        int j;
+        for(j = i; j < nframes; j++){
+            pager_free_slot(base + j);
+        }
+    }
+
+    _pager_pump();
+    return i;
+}
+
+int
+pager_pagein(int frame, pte_t* pte, int prio, pager_cb_t cb,
+             uintptr_t token){
+    struct pager_op* op;
+
+    assert(pte->swapped && pte->cap == seL4_CapNull && !pte->busy);
+
+    op = malloc(sizeof(*op));
+    if(op == NULL){
+        return !0;
+    }
+    op->write = 0;
+    op->prio = prio;
+    op->frame = frame;
+    op->pte = pte;
+    op->slot = pte->frame;
+    op->err = 0;
+    op->cb = cb;
+    op->token = token;
+    pte->busy = 1;
+    if(_pager_queue_op(op)){
+        pte->busy = 0;
+        free(op);
+        return !0;
+    }
+
+    _pager_pump();
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _PAGER_H_
+#define _PAGER_H_
+
+#include <stdint.h>
+#include <sel4/sel4.h>
+
+#include "addrspace.h"
+
+/* Name of the pagefile, relative to the NFS mount point */
+#define PAGEFILE_NAME       "pagefile"
+/* Maximum size of the pagefile in pages */
+#define PAGEFILE_MAX_PAGES  (16 * 1024)
+/* Maximum number of victims written back together. At most 32, and a
+ * divisor of PAGEFILE_MAX_PAGES */
+#define PAGER_CLUSTER       (8)
+
+/**
+ * Called once the I/O for a page has completed
+ * @param token the token given when the I/O was requested
+ * @param err 0 if the I/O succeeded
+ */
+typedef void (*pager_cb_t)(uintptr_t token, int err);
+
+/**
+ * Creates the pagefile on the NFS mount
+ * @pre the network must be initialised
+ * @return 0 on success
+ */
+int pager_init(void);
+
+/**
+ * Polls the network until an asynchronous operation sets *done.
+ * Other I/O continues to complete while we wait.
+ */
+void pager_wait(volatile int* done);
+
+/**
+ * Starts writing a cluster of dirty frames out to contiguous pagefile slots.
+ * Each page is marked busy until its write completes, at which point
+ * its owner's cap is deleted, the pte becomes a swapped entry and cb is
+ * called with the frame number as the token. Faults on busy pages wait.
+ * @param nframes the number of frames in the cluster
+ * @param frames the frames to evict
+ * @param ptes the unmapped page table entries owning each frame
+ * @param cb called as each page's write completes
+ * @return the number of frames (from the start of the array) for which
+ *         I/O was started; the rest were left untouched
+ */
+int pager_pageout(int nframes, const int* frames, pte_t** ptes, pager_cb_t cb);
+
+/**
+ * Starts reading a page back in from the pagefile. The page is marked
+ * busy until the read completes; its slot is then handed to the frame
+ * table as a clean copy of the frame and cb called. The pte still needs
+ * to be mapped by the caller.
+ * @param frame the frame to read the page into
+ * @param pte the swapped page table entry of the page
+ * @param prio the priority of the process waiting for the page. Reads
+ *        are sent highest priority first.
+ * @return 0 if the read was started
+ */
+int pager_pagein(int frame, pte_t* pte, int prio, pager_cb_t cb,
+                 uintptr_t token);
+
+/**
+ * Takes another reference to a slot in use, so that several swapped
+ * page table entries can share it. Each is released by pager_free_slot.
+ * @param slot the slot recorded in a swapped page table entry
+ */
+void pager_ref_slot(int slot);
+
+/**
+ * Releases a reference to a pagefile slot. The slot is free once its
+ * last reference has gone.
+ * @param slot the slot recorded in a swapped page table entry
+ */
+void pager_free_slot(int slot);
+
+#endif /* _PAGER_H_ */
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Latency statistics for system calls, page faults and interrupts, as
+ * described in sos_syscall.h. Recording an event is a clock read and a
+ * few increments, so it is always on.
+ */
+#include <string.h>
+
+#include <sos_syscall.h>
+
+#include "perf.h"
+
+static struct sos_perf _perf;
+
+/*
+ * The histogram bucket for a duration: one more than the position of its
+ * highest set bit
+ */
+static int
+_perf_bucket(uint64_t usecs){
+    int b = 0;
+
+    while(usecs != 0 && b < SOS_PERF_BUCKETS - 1){
+        usecs >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void
+perf_record(int kind, int pid, uint64_t start){
+    uint64_t usecs = clock_page_time() - start;
+    struct sos_perf_event* e;
+
+    if(kind < 0 || kind >= SOS_PERF_KINDS){
+        return;
+    }
+    _perf.hist[kind][_perf_bucket(usecs)]++;
+
+    e = &_perf.events[_perf.nevents % SOS_PERF_EVENTS];
+    e->kind = kind;
+    e->pid = pid;
+    e->start = start;
+    e->usecs = (usecs > UINT32_MAX) ? UINT32_MAX : usecs;
+    _perf.nevents++;
+}
+
+size_t
+perf_copy(void* buf, int clear){
+    memcpy(buf, &_perf, sizeof(_perf));
+    if(clear){
+        memset(&_perf, 0, sizeof(_perf));
+    }
+    return sizeof(_perf);
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "clockpage.h"
+
+/**
+ * @return the time at which an event starts, for perf_record
+ */
+static inline uint64_t
+perf_start(void){
+    return clock_page_time();
+}
+
+/**
+ * Records an event that has just finished
+ * @param kind a system call number, SOS_PERF_VM_FAULT or SOS_PERF_IRQ.
+ *        Anything else is ignored.
+ * @param pid the process the event was for, or 0
+ * @param start the time returned by perf_start when it began
+ */
+void perf_record(int kind, int pid, uint64_t start);
+
+/**
+ * Copies the statistics out as a struct sos_perf
+ * @param buf where to copy them, which must hold a struct sos_perf
+ * @param clear non zero to clear them afterwards
+ * @return the number of bytes copied
+ */
+size_t perf_copy(void* buf, int clear);
+
+#endif /* _PERF_H_ */
@@ -0,0 +1,333 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cpio/cpio.h>
+#include <elf/elf.h>
+
+#include "process.h"
+#include "clockpage.h"
+#include "file.h"
+#include "ring.h"
+#include "frametable.h"
+#include "objcache.h"
+#include "elf.h"
+#include "vmem_layout.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+#define PAGESIZE             (1 << (seL4_PageBits))
+
+/* This is the index where a clients syscall enpoint will
+ * be stored in the clients cspace. */
+#define USER_EP_CAP          (1)
+
+/* The linker will link this symbol to the start address  *
+ * of an archive of attached applications.                */
+extern char _cpio_archive[];
+
+static process_t* _process_table[MAX_PROCESSES];
+
+static int
+_alloc_pid(void){
+    static int next_pid = 1;
+    int i;
+
+    for(i = 0; i < MAX_PROCESSES - 1; i++){
+        int pid = next_pid;
+        next_pid = (next_pid % (MAX_PROCESSES - 1)) + 1;
+        if(_process_table[pid] == NULL){
+            return pid;
+        }
+    }
+    return -1;
+}
+
+static int
+_setup_regions(addrspace_t* as){
+    if(as_define_region(as, PROCESS_STACK_TOP - PROCESS_STACK_SIZE,
+                        PROCESS_STACK_SIZE, seL4_AllRights) == NULL){
+        return !0;
+    }
+    if(as_define_region(as, PROCESS_HEAP_START,
+                        PROCESS_HEAP_END - PROCESS_HEAP_START,
+                        seL4_AllRights) == NULL){
+        return !0;
+    }
+    if(as_define_region(as, PROCESS_IPC_BUFFER, PAGESIZE,
+                        seL4_AllRights) == NULL){
+        return !0;
+    }
+    if(as_define_region(as, PROCESS_IO_BUFFER, PROCESS_IO_SIZE,
+                        seL4_CanRead | seL4_CanWrite) == NULL){
+        return !0;
+    }
+    return 0;
+}
+
+/*
+ * Allocates a process with an empty address space, a cspace holding its
+ * syscall endpoint and an unconfigured TCB
+ */
+static process_t*
+_process_alloc(const char* name, seL4_CPtr fault_ep){
+    process_t* proc;
+    seL4_CPtr user_ep_cap;
+
+    proc = malloc(sizeof(*proc));
+    if(proc == NULL){
+        return NULL;
+    }
+    memset(proc, 0, sizeof(*proc));
+
+    proc->pid = _alloc_pid();
+    if(proc->pid < 0){
+        free(proc);
+        return NULL;
+    }
+    strncpy(proc->name, name, PROCESS_NAME_LEN - 1);
+    _process_table[proc->pid] = proc;
+
+    /* Create a VSpace */
+    proc->as = as_create();
+    if(proc->as == NULL){
+        process_destroy(proc);
+        return NULL;
+    }
+
+    /* Create a 2 level CSpace, which grows as the process is given caps */
+    proc->croot = cspace_create(2);
+    if(proc->croot == NULL){
+        process_destroy(proc);
+        return NULL;
+    }
+
+    /* Copy the fault endpoint to the user app to enable IPC */
+    user_ep_cap = cspace_mint_cap(proc->croot,
+                                  cur_cspace,
+                                  fault_ep,
+                                  seL4_AllRights,
+                                  seL4_CapData_Badge_new(proc->pid));
+    /* should be the first slot in the space, hack I know */
+    assert(user_ep_cap == USER_EP_CAP);
+
+    /* Take a TCB object */
+    proc->tcb_cap = objcache_alloc(OBJCACHE_TCB, &proc->tcb_addr);
+    if(proc->tcb_cap == CSPACE_NULL){
+        process_destroy(proc);
+        return NULL;
+    }
+
+    return proc;
+}
+
+int
+process_map_pinned(process_t* proc, seL4_Word vaddr, seL4_CapRights rights){
+    int frame;
+    int err;
+
+    frame = frame_alloc();
+    if(frame == FRAME_INVALID){
+        return FRAME_INVALID;
+    }
+    err = as_map_frame(proc->as, vaddr, frame, rights);
+    if(err){
+        frame_free(frame);
+        return FRAME_INVALID;
+    }
+    frame_pin(frame);
+    return frame;
+}
+
+/*
+ * Gives the process an IPC buffer and I/O buffer and configures its TCB.
+ * @pre the IPC buffer and I/O buffer regions must have been defined
+ */
+static int
+_process_configure(process_t* proc){
+    pte_t* ipc_pte;
+    int err;
+
+    /* Create an IPC buffer. It must be resident before the TCB can use it,
+     * and the kernel holds its own reference to it */
+    if(process_map_pinned(proc, PROCESS_IPC_BUFFER,
+                          seL4_AllRights) == FRAME_INVALID){
+        return !0;
+    }
+    ipc_pte = as_lookup_pte(proc->as, PROCESS_IPC_BUFFER, 0);
+    assert(ipc_pte != NULL);
+
+    /* The I/O buffer is a single page, which SOS reaches through the
+     * frame window while requests are in flight */
+    assert(PROCESS_IO_SIZE == PAGESIZE);
+    proc->io_frame = process_map_pinned(proc, PROCESS_IO_BUFFER,
+                                        seL4_CanRead | seL4_CanWrite);
+    if(proc->io_frame == FRAME_INVALID){
+        return !0;
+    }
+    proc->io_buf = frame_vaddr(proc->io_frame);
+
+    /* Configure the TCB */
+    err = seL4_TCB_Configure(proc->tcb_cap, USER_EP_CAP, proc->priority,
+                             proc->croot->root_cnode, seL4_NilData,
+                             proc->as->vroot, seL4_NilData, PROCESS_IPC_BUFFER,
+                             ipc_pte->cap);
+    conditional_panic(err, "Unable to configure new TCB");
+    return 0;
+}
+
+process_t*
+process_create(const char* app_name, seL4_CPtr fault_ep, int priority){
+    int err;
+
+    process_t* proc;
+
+    /* These required for setting up the TCB */
+    seL4_UserContext context;
+
+    /* These required for loading program sections */
+    char* elf_base;
+    unsigned long elf_size;
+
+    assert(priority >= SOS_PRIO_MIN && priority <= SOS_PRIO_MAX);
+    proc = _process_alloc(app_name, fault_ep);
+    if(proc == NULL){
+        return NULL;
+    }
+    proc->priority = priority;
+    err = _setup_regions(proc->as);
+    if(err){
+        process_destroy(proc);
+        return NULL;
+    }
+    err = _process_configure(proc);
+    if(err){
+        process_destroy(proc);
+        return NULL;
+    }
+    err = clock_page_map(proc);
+    if(err){
+        process_destroy(proc);
+        return NULL;
+    }
+
+    /* parse the cpio image */
+    dprintf(1, "\nStarting \"%s\"...\n", app_name);
+    elf_base = cpio_get_file(_cpio_archive, app_name, &elf_size);
+    if(elf_base == NULL){
+        dprintf(0, "Unable to locate cpio header for %s\n", app_name);
+        process_destroy(proc);
+        return NULL;
+    }
+
+    /* load the elf image */
+    err = elf_load(proc->as, elf_base);
+    if(err){
+        dprintf(0, "Failed to load elf image %s\n", app_name);
+        process_destroy(proc);
+        return NULL;
+    }
+
+    /* Start the new process. The stack is faulted in on first use */
+    memset(&context, 0, sizeof(context));
+    context.pc = elf_getEntryPoint(elf_base);
+    context.sp = PROCESS_STACK_TOP;
+    seL4_TCB_WriteRegisters(proc->tcb_cap, 1, 0, 2, &context);
+
+    return proc;
+}
+
+process_t*
+process_clone(process_t* parent, seL4_CPtr fault_ep){
+    int err;
+
+    process_t* proc;
+    seL4_UserContext context;
+    seL4_MessageInfo_t reply;
+
+    proc = _process_alloc(parent->name, fault_ep);
+    if(proc == NULL){
+        return NULL;
+    }
+    proc->priority = parent->priority;
+
+    /* Share the parent's memory, except for its IPC buffer */
+    err = as_clone(proc->as, parent->as);
+    if(err){
+        dprintf(0, "Failed to clone the address space of %d\n", parent->pid);
+        process_destroy(proc);
+        return NULL;
+    }
+    err = _process_configure(proc);
+    if(err){
+        process_destroy(proc);
+        return NULL;
+    }
+
+    err = ring_clone(proc, parent);
+    if(err){
+        process_destroy(proc);
+        return NULL;
+    }
+
+    /* Open files, and their offsets, are shared with the parent */
+    file_clone_all(proc, parent);
+
+    /* The parent is blocked in seL4_Call and will restart at the swi
+     * instruction. Start the child just past it, as if SOS had replied
+     * with a single word: its pid, 0. */
+    err = seL4_TCB_ReadRegisters(parent->tcb_cap, 0, 0,
+                                 sizeof(context) / sizeof(seL4_Word), &context);
+    conditional_panic(err, "Unable to read registers");
+    reply = seL4_MessageInfo_new(0, 0, 0, 1);
+    context.pc += sizeof(seL4_Word);
+    context.r1 = reply.words[0];
+    context.r2 = 0;
+    seL4_TCB_WriteRegisters(proc->tcb_cap, 1, 0,
+                            sizeof(context) / sizeof(seL4_Word), &context);
+
+    dprintf(1, "Cloned process %d as %d\n", parent->pid, proc->pid);
+    return proc;
+}
+
+void
+process_destroy(process_t* proc){
+    /* Completions still in flight for it must no longer find it */
+    _process_table[proc->pid] = NULL;
+    if(proc->tcb_cap != seL4_CapNull){
+        objcache_free(OBJCACHE_TCB, proc->tcb_cap, proc->tcb_addr);
+        proc->tcb_cap = seL4_CapNull;
+    }
+    if(proc->croot != NULL){
+        cspace_destroy(proc->croot);
+        proc->croot = NULL;
+    }
+    if(proc->as != NULL){
+        /* Freed later if the pager still has pages of it in flight */
+        as_destroy(proc->as);
+        proc->as = NULL;
+    }
+    file_close_all(proc);
+    ring_destroy(proc);
+    free(proc);
+}
+
+process_t*
+process_lookup(seL4_Word badge){
+    if(badge == 0 || badge >= MAX_PROCESSES){
+        return NULL;
+    }
+    return _process_table[badge];
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _PROCESS_H_
+#define _PROCESS_H_
+
+#include <stdint.h>
+#include <sel4/sel4.h>
+#include <cspace/cspace.h>
+
+#include <autoconf.h>
+
+#include "addrspace.h"
+#include "syscall.h"
+
+/* Process IDs double as the badge of each process's endpoint cap,
+ * so they must be non zero and stay clear of the IRQ badge bit */
+#define MAX_PROCESSES       (32)
+#define PROCESS_NAME_LEN    (32)
+/* Must match PROCESS_MAX_FILES in sos.h */
+#define PROCESS_MAX_FILES   (CONFIG_SOS_MAX_FILES)
+/* Words in the bitmap of descriptors in use */
+#define PROCESS_FD_WORDS    ((PROCESS_MAX_FILES + 31) / 32)
+#if PROCESS_FD_WORDS > 32
+#error "Too many files per process for the descriptor bitmap"
+#endif
+/* Frames a new process needs for its IPC and I/O buffers */
+#define PROCESS_PINNED_FRAMES   (2)
+
+struct file;
+struct sos_ring;
+
+typedef struct process {
+    int pid;
+    int priority;               /* see SOS_PRIO_MAX */
+
+    seL4_Word tcb_addr;
+    seL4_TCB tcb_cap;
+
+    cspace_t* croot;
+    addrspace_t* as;
+
+    /* The page shared with the process for read and write data */
+    int io_frame;
+    char* io_buf;
+
+    struct file* files[PROCESS_MAX_FILES];
+    uint32_t fd_used[PROCESS_FD_WORDS];  /* a bit per descriptor in use */
+    uint32_t fd_full;           /* a bit per word of fd_used with none free */
+
+    /* The optional submission ring, see sos_syscall.h */
+    struct sos_ring* ring;      /* SOS's view, NULL until set up */
+    int ring_inflight;          /* entries taken but not yet complete */
+    syscall_caller_t ring_waiter;   /* a RING_ENTER waiting for them */
+    seL4_Word ring_taken;       /* its return value */
+
+    char name[PROCESS_NAME_LEN];
+} process_t;
+
+/**
+ * Creates and starts a new process running an executable from the
+ * cpio archive. PROCESS_PINNED_FRAMES frames are allocated, so reserve
+ * them first to avoid waiting for the pager.
+ * @param app_name the name of the executable
+ * @param fault_ep the endpoint on which SOS receives syscalls and faults
+ * @param priority the priority of its thread, from SOS_PRIO_MIN to
+ *        SOS_PRIO_MAX, by which SOS also orders work done for it
+ * @return the new process, or NULL on failure
+ */
+process_t* process_create(const char* app_name, seL4_CPtr fault_ep,
+                          int priority);
+
+/**
+ * Creates a copy of a process that is blocked in a system call. Memory
+ * is shared copy on write; the child starts by returning 0 from the
+ * system call, at the parent's priority. Like process_create, frames are
+ * allocated for the child:
+ * one more if the parent has a submission ring.
+ * @pre every page of the parent must be resident, see vm_page_in_all
+ * @param parent the process to copy
+ * @param fault_ep the endpoint on which SOS receives syscalls and faults
+ * @return the new process, or NULL on failure
+ */
+process_t* process_clone(process_t* parent, seL4_CPtr fault_ep);
+
+/**
+ * Allocates a frame, maps it into a process and pins it, for memory SOS
+ * shares with the process
+ * @pre vaddr must lie in a region of the process
+ * @return the frame, or FRAME_INVALID on failure
+ */
+int process_map_pinned(process_t* proc, seL4_Word vaddr,
+                       seL4_CapRights rights);
+
+/**
+ * Destroys a process, releasing all resources it holds
+ */
+void process_destroy(process_t* proc);
+
+/**
+ * Finds the process that sent a message
+ * @param badge the badge of the received message
+ * @return the process or NULL if the badge does not belong to a process
+ */
+process_t* process_lookup(seL4_Word badge);
+
+#endif /* _PROCESS_H_ */
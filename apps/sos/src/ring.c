@@ -0,0 +1,176 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Batched system calls. A process queues operations in a page it shares
+ * with SOS and makes a single RING_ENTER call to have them all started.
+ * Each entry is run as a system call of its own, so operations that have
+ * to wait complete into their entry later rather than holding up the
+ * rest of the batch. The layout is described in sos_syscall.h.
+ */
+#include <string.h>
+#include <assert.h>
+
+#include <cspace/cspace.h>
+#include <sos_syscall.h>
+
+#include "file.h"
+#include "frametable.h"
+#include "ring.h"
+#include "syscall.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+int
+ring_setup(process_t* proc){
+    int frame;
+
+    if(proc->ring != NULL){
+        return 0;
+    }
+    if(as_define_region(proc->as, SOS_RING_BUFFER, SOS_RING_SIZE,
+                        seL4_CanRead | seL4_CanWrite) == NULL){
+        return !0;
+    }
+    frame = process_map_pinned(proc, SOS_RING_BUFFER,
+                               seL4_CanRead | seL4_CanWrite);
+    if(frame == FRAME_INVALID){
+        return !0;
+    }
+    /* Frames come zero filled, so the ring starts empty */
+    proc->ring = frame_vaddr(frame);
+    return 0;
+}
+
+int
+ring_clone(process_t* child, process_t* parent){
+    int frame;
+    int i;
+
+    if(parent->ring == NULL){
+        return 0;
+    }
+    /* The region was copied along with the rest of the address space */
+    frame = process_map_pinned(child, SOS_RING_BUFFER,
+                               seL4_CanRead | seL4_CanWrite);
+    if(frame == FRAME_INVALID){
+        return !0;
+    }
+    child->ring = frame_vaddr(frame);
+    memcpy(child->ring, parent->ring, SOS_RING_SIZE);
+    for(i = 0; i < SOS_RING_ENTRIES; i++){
+        if(!child->ring->entries[i].done){
+            child->ring->entries[i].result = -1;
+            child->ring->entries[i].done = 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Starts a single entry
+ * @return the result of the operation, unless it was deferred
+ */
+static int
+_ring_run(syscall_ctx_t* ctx, process_t* proc, struct sos_ring_entry* e){
+    /* Read each field once; the process may change them under us */
+    int op = e->op;
+    unsigned int data = e->data;
+    unsigned int nbyte = e->nbyte;
+
+    if(op == SOS_RING_OP_NOP){
+        return 0;
+    }
+    if(data < SOS_RING_DATA || data > SOS_RING_SIZE ||
+       nbyte > SOS_RING_SIZE - data){
+        return -1;
+    }
+    switch(op){
+    case SOS_RING_OP_READ:
+        return file_read(ctx, proc, e->fd, (char*)proc->ring + data, nbyte);
+    case SOS_RING_OP_WRITE:
+        return file_write(ctx, proc, e->fd, (char*)proc->ring + data,
+                          nbyte);
+    default:
+        return -1;
+    }
+}
+
+seL4_Word
+ring_enter(syscall_ctx_t* ctx, process_t* proc, int wait){
+    struct sos_ring* ring = proc->ring;
+    unsigned int head;
+    unsigned int tail;
+    seL4_Word taken = 0;
+
+    if(ring == NULL){
+        return -1;
+    }
+    head = ring->head;
+    tail = ring->tail;
+    if(tail - head > SOS_RING_ENTRIES){
+        return -1;
+    }
+
+    for(; head != tail; head++){
+        int slot = head % SOS_RING_ENTRIES;
+        struct sos_ring_entry* e = &ring->entries[slot];
+        syscall_ctx_t entry;
+        int ret;
+
+        e->done = 0;
+        syscall_ring_begin(&entry, ctx, slot, (e->op == SOS_RING_OP_WRITE) ?
+                           SOS_SYSCALL_WRITE : SOS_SYSCALL_READ);
+        ret = _ring_run(&entry, proc, e);
+        if(!syscall_ring_end(&entry)){
+            e->result = ret;
+            e->done = 1;
+        }
+        ring->head = head + 1;
+        taken++;
+    }
+    dprintf(1, "ring: process %d submitted %d entries\n", proc->pid, taken);
+
+    if(wait && proc->ring_inflight > 0){
+        assert(proc->ring_waiter.reply_cap == CSPACE_NULL);
+        proc->ring_waiter = syscall_defer(ctx);
+        proc->ring_taken = taken;
+    }
+    return taken;
+}
+
+void
+ring_complete(process_t* proc, int slot, seL4_Word ret){
+    struct sos_ring_entry* e = &proc->ring->entries[slot];
+    syscall_caller_t waiter;
+
+    e->result = ret;
+    e->done = 1;
+
+    assert(proc->ring_inflight > 0);
+    if(--proc->ring_inflight > 0 ||
+       proc->ring_waiter.reply_cap == CSPACE_NULL){
+        return;
+    }
+    waiter = proc->ring_waiter;
+    proc->ring_waiter.reply_cap = CSPACE_NULL;
+    syscall_reply(waiter, proc->ring_taken);
+}
+
+void
+ring_destroy(process_t* proc){
+    if(proc->ring_waiter.reply_cap != CSPACE_NULL){
+        cspace_free_slot(cur_cspace, proc->ring_waiter.reply_cap);
+        proc->ring_waiter.reply_cap = CSPACE_NULL;
+    }
+    proc->ring = NULL;
+}
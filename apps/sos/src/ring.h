@@ -0,0 +1,52 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <sel4/sel4.h>
+
+#include "process.h"
+
+/**
+ * Maps a submission ring into a process. Does nothing if the process
+ * already has one. A single frame is allocated.
+ * @return 0 on success
+ */
+int ring_setup(process_t* proc);
+
+/**
+ * Gives a newly cloned process a copy of its parent's ring. Entries the
+ * parent still has in flight are failed in the copy.
+ * @return 0 on success
+ */
+int ring_clone(process_t* child, process_t* parent);
+
+/**
+ * Takes and starts every entry submitted to a process's ring
+ * @param ctx the RING_ENTER call
+ * @param wait non zero to defer the system call until every entry taken
+ *        so far has completed
+ * @return the number of entries taken, or -1 if the ring is corrupt
+ */
+seL4_Word ring_enter(syscall_ctx_t* ctx, process_t* proc, int wait);
+
+/**
+ * Completes a ring entry that was deferred, waking the process if it is
+ * waiting for the ring to drain
+ */
+void ring_complete(process_t* proc, int slot, seL4_Word ret);
+
+/**
+ * Releases ring state held for a process that is being destroyed
+ */
+void ring_destroy(process_t* proc);
+
+#endif /* _RING_H_ */
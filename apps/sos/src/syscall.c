@@ -0,0 +1,388 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * System call dispatch. The calling convention is described in
+ * sos_syscall.h, which is shared with libsos.
+ *
+ * Calls that need memory, and so may have to wait for the pager, run as
+ * continuations. In the common case they finish straight away and are
+ * answered like any other call.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cspace/cspace.h>
+#include <sos_syscall.h>
+
+#include "cont.h"
+#include "file.h"
+#include "perf.h"
+#include "process.h"
+#include "ring.h"
+#include "syscall.h"
+#include "vm.h"
+#include "vmem_layout.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+extern seL4_CPtr _sos_ipc_ep_cap;
+
+/* A system call that may have to wait for memory before it can run */
+struct syscall_cont {
+    struct cont cont;           /* must be first */
+    seL4_Word syscall;
+    int pid;
+    syscall_caller_t caller;    /* once deferred */
+    int deferred;
+    int finished;
+    seL4_Word ret;
+    int priority;               /* process create only */
+    char path[SOS_PATH_MAX];
+};
+
+/*
+ * Unpacks a path sent by sos_pack_path in libsos
+ * @return 0 on success
+ */
+static int
+_syscall_get_path(int mr, int num_args, char* path){
+    seL4_Word len = seL4_GetMR(mr);
+    int nwords = (len + sizeof(seL4_Word) - 1) / sizeof(seL4_Word);
+
+    if(len >= SOS_PATH_MAX || mr + nwords > num_args){
+        return !0;
+    }
+    memcpy(path, &seL4_GetIPCBuffer()->msg[mr + 1], len);
+    path[len] = '\0';
+    return 0;
+}
+
+static seL4_Word
+_sys_process_create(process_t* caller, const char* path, int priority){
+    process_t* proc;
+
+    proc = process_create(path, _sos_ipc_ep_cap, priority);
+    if(proc == NULL){
+        dprintf(0, "syscall: unable to start %s\n", path);
+        return -1;
+    }
+    dprintf(1, "syscall: process %d started %s as %d\n",
+            caller->pid, path, proc->pid);
+    return proc->pid;
+}
+
+static seL4_Word
+_sys_process_clone(process_t* caller){
+    process_t* proc;
+
+    proc = process_clone(caller, _sos_ipc_ep_cap);
+    if(proc == NULL){
+        dprintf(0, "syscall: unable to clone process %d\n", caller->pid);
+        return -1;
+    }
+    return proc->pid;
+}
+
+static seL4_Word
+_sys_open(syscall_ctx_t* ctx, process_t* caller, int num_args){
+    char path[SOS_PATH_MAX];
+
+    if(num_args < 2 || _syscall_get_path(2, num_args, path)){
+        return -1;
+    }
+    return file_open(ctx, caller, path, seL4_GetMR(1));
+}
+
+/*
+ * Read and write move their data through the caller's I/O buffer, so the
+ * message carries only where it starts in the buffer and its length
+ */
+static seL4_Word
+_sys_read(syscall_ctx_t* ctx, process_t* caller, int num_args){
+    seL4_Word io_off, nbyte;
+
+    if(num_args < 3){
+        return -1;
+    }
+    io_off = seL4_GetMR(2);
+    nbyte = seL4_GetMR(3);
+    if(io_off > PROCESS_IO_SIZE || nbyte > PROCESS_IO_SIZE - io_off){
+        return -1;
+    }
+    return file_read(ctx, caller, seL4_GetMR(1), caller->io_buf + io_off,
+                     nbyte);
+}
+
+static seL4_Word
+_sys_write(syscall_ctx_t* ctx, process_t* caller, int num_args){
+    seL4_Word io_off, nbyte;
+
+    if(num_args < 3){
+        return -1;
+    }
+    io_off = seL4_GetMR(2);
+    nbyte = seL4_GetMR(3);
+    if(io_off > PROCESS_IO_SIZE || nbyte > PROCESS_IO_SIZE - io_off){
+        return -1;
+    }
+    return file_write(ctx, caller, seL4_GetMR(1), caller->io_buf + io_off,
+                      nbyte);
+}
+
+/*
+ * Runs a system call once the memory it needs is available: the caller's
+ * pages for a clone, and the frames the call allocates
+ * @return CONT_WAIT, or CONT_DONE with the result in *ret
+ */
+static int
+_syscall_cont_try(struct syscall_cont* sc, process_t* proc, seL4_Word* ret){
+    struct cont* c = &sc->cont;
+    int nframes;
+    int err;
+
+    *ret = -1;
+    if(sc->syscall == SOS_SYSCALL_PROCESS_CLONE){
+        err = vm_page_in_all(proc->as, c);
+        if(err == VM_FAULT_PENDING){
+            return CONT_WAIT;
+        }else if(err){
+            return CONT_DONE;
+        }
+        nframes = PROCESS_PINNED_FRAMES + (proc->ring != NULL);
+    }else if(sc->syscall == SOS_SYSCALL_RING_SETUP){
+        nframes = 1;
+    }else{
+        nframes = PROCESS_PINNED_FRAMES;
+    }
+    err = cont_reserve_frames(c, nframes);
+    if(err == CONT_WAIT){
+        return CONT_WAIT;
+    }else if(err){
+        return CONT_DONE;
+    }
+
+    /* Nothing runs between here and the allocations, so the frames
+     * handed back are the ones they get */
+    cont_release_frames(c);
+    switch(sc->syscall){
+    case SOS_SYSCALL_PROCESS_CREATE:
+        *ret = _sys_process_create(proc, sc->path, sc->priority);
+        break;
+    case SOS_SYSCALL_PROCESS_CLONE:
+        *ret = _sys_process_clone(proc);
+        break;
+    case SOS_SYSCALL_RING_SETUP:
+        *ret = ring_setup(proc) ? -1 : 0;
+        break;
+    default:
+        assert(!"Not a continuation system call");
+    }
+    return CONT_DONE;
+}
+
+static int
+_syscall_cont_step(struct cont* c){
+    struct syscall_cont* sc = (struct syscall_cont*)c;
+    process_t* proc;
+    seL4_Word ret = -1;
+
+    proc = process_lookup(sc->pid);
+    if(proc != NULL && !c->err &&
+       _syscall_cont_try(sc, proc, &ret) == CONT_WAIT){
+        return CONT_WAIT;
+    }
+
+    cont_release_frames(c);
+    if(sc->deferred){
+        syscall_reply(sc->caller, ret);
+        free(sc);
+    }else{
+        sc->ret = ret;
+        sc->finished = 1;
+    }
+    return CONT_DONE;
+}
+
+/*
+ * Starts a system call that may have to wait for memory, deferring it if
+ * it cannot finish straight away
+ */
+static seL4_Word
+_syscall_start(syscall_ctx_t* ctx, process_t* proc, int num_args){
+    struct syscall_cont* sc;
+    seL4_Word ret;
+
+    sc = malloc(sizeof(*sc));
+    if(sc == NULL){
+        return -1;
+    }
+    sc->syscall = ctx->syscall;
+    sc->pid = ctx->pid;
+    sc->deferred = 0;
+    sc->finished = 0;
+    if(sc->syscall == SOS_SYSCALL_PROCESS_CREATE){
+        if(num_args < 2 || _syscall_get_path(2, num_args, sc->path)){
+            free(sc);
+            return -1;
+        }
+        sc->priority = (int)seL4_GetMR(1);
+        if(sc->priority < SOS_PRIO_MIN || sc->priority > SOS_PRIO_MAX){
+            free(sc);
+            return -1;
+        }
+    }
+
+    cont_start(&sc->cont, _syscall_cont_step, proc->priority);
+    if(sc->finished){
+        ret = sc->ret;
+        free(sc);
+        return ret;
+    }
+    sc->caller = syscall_defer(ctx);
+    sc->deferred = 1;
+    return 0;
+}
+
+syscall_caller_t
+syscall_defer(syscall_ctx_t* ctx){
+    syscall_caller_t caller;
+
+    assert(!ctx->deferred);
+    caller.pid = ctx->pid;
+    caller.ring_slot = ctx->ring_slot;
+    caller.syscall = ctx->syscall;
+    caller.start = ctx->start;
+    if(ctx->ring_slot >= 0){
+        process_t* proc = process_lookup(ctx->pid);
+        proc->ring_inflight++;
+        caller.reply_cap = CSPACE_NULL;
+    }else{
+        caller.reply_cap = cspace_save_reply_cap(cur_cspace);
+        assert(caller.reply_cap != CSPACE_NULL);
+    }
+    ctx->deferred = 1;
+    return caller;
+}
+
+void
+syscall_reply(syscall_caller_t caller, seL4_Word ret){
+    process_t* proc = process_lookup(caller.pid);
+
+    perf_record(caller.syscall, caller.pid, caller.start);
+    if(caller.ring_slot >= 0){
+        if(proc != NULL){
+            ring_complete(proc, caller.ring_slot, ret);
+        }
+        return;
+    }
+
+    if(proc != NULL){
+        seL4_SetMR(0, ret);
+        seL4_Send(caller.reply_cap, seL4_MessageInfo_new(0, 0, 0, 1));
+    }
+    /* Free the saved reply cap */
+    cspace_free_slot(cur_cspace, caller.reply_cap);
+}
+
+void
+syscall_ring_begin(syscall_ctx_t* entry, syscall_ctx_t* ctx, int slot,
+                   seL4_Word syscall){
+    entry->pid = ctx->pid;
+    entry->syscall = syscall;
+    entry->start = perf_start();
+    entry->ring_slot = slot;
+    entry->deferred = 0;
+}
+
+int
+syscall_ring_end(syscall_ctx_t* entry){
+    if(!entry->deferred){
+        perf_record(entry->syscall, entry->pid, entry->start);
+    }
+    return entry->deferred;
+}
+
+int
+handle_syscall(seL4_Word badge, int num_args){
+    seL4_Word syscall_number;
+    seL4_Word ret;
+    process_t* proc;
+    syscall_ctx_t ctx;
+
+    syscall_number = seL4_GetMR(0);
+
+    proc = process_lookup(badge);
+    if(proc == NULL){
+        printf("Syscall from unknown badge %d\n", badge);
+        return 0;
+    }
+
+    /* Process system call */
+    ctx.pid = proc->pid;
+    ctx.syscall = syscall_number;
+    ctx.start = perf_start();
+    ctx.ring_slot = -1;
+    ctx.deferred = 0;
+    switch(syscall_number){
+    case SOS_SYSCALL_NULL:
+        dprintf(1, "syscall: thread made syscall 0!\n");
+        ret = 0;
+        break;
+
+    case SOS_SYSCALL_PROCESS_CREATE:
+    case SOS_SYSCALL_PROCESS_CLONE:
+    case SOS_SYSCALL_RING_SETUP:
+        ret = _syscall_start(&ctx, proc, num_args);
+        break;
+
+    case SOS_SYSCALL_OPEN:
+        ret = _sys_open(&ctx, proc, num_args);
+        break;
+
+    case SOS_SYSCALL_CLOSE:
+        ret = (num_args < 1) ? -1 : file_close(proc, seL4_GetMR(1));
+        break;
+
+    case SOS_SYSCALL_READ:
+        ret = _sys_read(&ctx, proc, num_args);
+        break;
+
+    case SOS_SYSCALL_WRITE:
+        ret = _sys_write(&ctx, proc, num_args);
+        break;
+
+    case SOS_SYSCALL_RING_ENTER:
+        ret = ring_enter(&ctx, proc, (num_args < 1) ? 0 : seL4_GetMR(1));
+        break;
+
+    case SOS_SYSCALL_PERF:
+        assert(sizeof(struct sos_perf) <= PROCESS_IO_SIZE);
+        ret = perf_copy(proc->io_buf, (num_args < 1) ? 0 : seL4_GetMR(1));
+        break;
+
+    default:
+        printf("Unknown syscall %d\n", syscall_number);
+        /* we don't want to reply to an unknown syscall */
+        return 0;
+    }
+
+    if(ctx.deferred){
+        /* The reply cap has been saved and the reply is sent later */
+        return 0;
+    }
+    perf_record(syscall_number, ctx.pid, ctx.start);
+    seL4_SetMR(0, ret);
+    return !0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _SYSCALL_H_
+#define _SYSCALL_H_
+
+#include <stdint.h>
+#include <sel4/sel4.h>
+
+/* The system call being handled. It lives on the stack of the handler
+ * and is passed to anything that may defer the call, so that a call
+ * started from a submission ring entry has state of its own. */
+typedef struct syscall_ctx {
+    int pid;                    /* the caller */
+    seL4_Word syscall;          /* for perf_record */
+    uint64_t start;
+    int ring_slot;              /* the ring entry being run, or -1 */
+    int deferred;
+} syscall_ctx_t;
+
+/* Identifies a deferred system call so that it can be completed later.
+ * It came either through the endpoint, with a saved reply cap, or from
+ * an entry of the caller's submission ring. */
+typedef struct syscall_caller {
+    int pid;
+    seL4_CPtr reply_cap;        /* CSPACE_NULL for ring entries */
+    int ring_slot;
+    seL4_Word syscall;          /* for perf_record */
+    uint64_t start;
+} syscall_caller_t;
+
+/**
+ * Handles a system call. The arguments are in SOS's message registers.
+ * @param badge the badge of the calling process
+ * @param num_args the number of message registers following the
+ *        syscall number
+ * @return non zero if the return value has been placed in MR0 and the
+ *         caller should be replied to with a single word, or 0 if the
+ *         system call was deferred with syscall_defer or is never answered
+ */
+int handle_syscall(seL4_Word badge, int num_args);
+
+/**
+ * Lets the system call being handled wait for I/O, saving the caller's
+ * reply cap if it came through the endpoint. Only system calls that block
+ * need to do this; the value they return to handle_syscall is then
+ * ignored.
+ * @param ctx the system call being handled
+ * @return the caller, to be passed to syscall_reply
+ */
+syscall_caller_t syscall_defer(syscall_ctx_t* ctx);
+
+/**
+ * Completes a system call deferred with syscall_defer. Nothing is sent
+ * if the caller has exited in the meantime.
+ * @param caller the caller returned by syscall_defer
+ * @param ret the return value of the system call
+ */
+void syscall_reply(syscall_caller_t caller, seL4_Word ret);
+
+/**
+ * Sets up the context of a system call in an entry of a submission ring,
+ * which syscall_defer then defers in place of the RING_ENTER call
+ * @param entry the context to set up
+ * @param ctx the RING_ENTER call
+ * @param slot the ring entry
+ * @param syscall the system call the entry's operation corresponds to
+ */
+void syscall_ring_begin(syscall_ctx_t* entry, syscall_ctx_t* ctx, int slot,
+                        seL4_Word syscall);
+
+/**
+ * Finishes the work started by syscall_ring_begin
+ * @return non zero if the entry was deferred
+ */
+int syscall_ring_end(syscall_ctx_t* entry);
+
+#endif /* _SYSCALL_H_ */
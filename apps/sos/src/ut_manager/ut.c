@@ -155,7 +155,8 @@ static int ut_translate_device(seL4_Word addr, seL4_Untyped* ret_cptr,
     return !0;
 }
 
-int ut_translate(seL4_Word addr, seL4_Untyped* ret_cptr, seL4_Word* ret_offset){
+/* Returns the index of the untyped object holding addr, or -1 */
+static int _ut_find(seL4_Word addr){
     int start, end;
 
     start = 0;
@@ -169,17 +170,31 @@ int ut_translate(seL4_Word addr, seL4_Untyped* ret_cptr, seL4_Word* ret_offset){
         }else if(UT_PEND(index) <= addr){
             start = index + 1;
         }else{
-            /* Success */
-            *ret_cptr = UT_CAP(index);
-            *ret_offset = addr - UT_PSTART(index);
-            return 0;
+            return index;
         }
     }
+    return -1;
+}
+
+int ut_translate(seL4_Word addr, seL4_Untyped* ret_cptr, seL4_Word* ret_offset){
+    int index = _ut_find(addr);
+
+    if(index != -1){
+        /* Success */
+        *ret_cptr = UT_CAP(index);
+        *ret_offset = addr - UT_PSTART(index);
+        return 0;
+    }
 
     /* Check if the address matches a device */
     return ut_translate_device(addr, ret_cptr, ret_offset);
 }
 
+int ut_size_bits(seL4_Word addr){
+    int index = _ut_find(addr);
+    return (index == -1) ? -1 : UT_SIZEBITS(index);
+}
+
 int ut_table_init(const seL4_BootInfo *bi){
     if(!bi){
         return !0;
@@ -74,6 +74,13 @@ seL4_Word ut_steal_mem(int sizebits);
  */
 int ut_translate(seL4_Word addr, seL4_Untyped* ret_cptr, seL4_Word* ret_offset);
 
+/**
+ * Finds the size of the untyped object holding an address
+ * @param addr an address within the memory returned by ut_find_memory
+ * @return the size of the object in bits, or -1 if there is none
+ */
+int ut_size_bits(seL4_Word addr);
+
 /**
  * Initialise the allocator to manage memory from "low" to "high"
  * @param low the base address that the allocator should manage
@@ -83,8 +90,11 @@ void ut_allocator_init(seL4_Word low, seL4_Word high);
 
 /**
  * Reserve memory using the allocator
- * @param sizebits the amount of contiguous and aligned memory to reserve (2^sizebits)
- * @return the physical address of the reserved memory which can be passed to ut_translate
+ * @param sizebits the amount of contiguous and aligned memory to reserve
+ *        (2^sizebits), from seL4_EndpointBits up to the size of the
+ *        largest untyped object
+ * @return the physical address of the reserved memory which can be passed to ut_translate,
+ *         or 0 if there is no block that large
  */
 seL4_Word ut_alloc(int sizebits);
 
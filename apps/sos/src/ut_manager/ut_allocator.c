@@ -8,417 +8,296 @@
  * @TAG(NICTA_BSD)
  */
 
+/*
+ * A buddy allocator over untyped memory. Every block is a power of two in
+ * size and aligned to it. Allocation splits the smallest free block that
+ * is large enough, freeing merges a block with its buddy for as long as
+ * the buddy is also free. Untyped memory is not mapped into SOS, so free
+ * blocks are described by nodes kept in a list per size and in a hash of
+ * their addresses, through which a buddy is found. The hash starts out
+ * sized for the memory it covers and doubles whenever it holds more than
+ * two blocks per bucket, so a lookup stays constant time however
+ * fragmented memory becomes.
+ */
 #include <stdlib.h>
 #include <assert.h>
 
+#include <utils/util.h>
+
 #include "ut.h"
-#include "bitfield.h"
 
 
 #define verbose 1
 #include <sys/debug.h>
 #include <sys/panic.h>
- 
-#define FLOOR14(x) ((x) & ~((1 << 14) - 1))
-#define CEILING14(x) FLOOR14((x) + (1 << 14) - 1)
 
-typedef struct suballocator {
-    struct suballocator** prev;
-    struct suballocator* next;
-    seL4_Word base;
-    bitfield_t* bitfield;
-} suballocator_t;
+/* The smallest and largest blocks handed out */
+#define UT_MIN_SIZEBITS     seL4_EndpointBits
+#define UT_MAX_SIZEBITS     30
 
+/* Initially one bucket in the hash of free blocks for this much memory */
+#define UT_HASH_SPAN_BITS   (seL4_PageBits + 6)
+#define UT_HASH_MIN_BITS    6
 
+typedef struct ut_block {
+    seL4_Word addr;
+    int sizebits;
+    struct ut_block** prev;     /* in the free list of its size */
+    struct ut_block* next;
+    struct ut_block* hash_next;
+} ut_block_t;
 
-static bitfield_t*     _pool14 = NULL;
-static bitfield_t*     _pool12 = NULL;
-static bitfield_t*     _pool10 = NULL;
-static suballocator_t* _pool9  = NULL;
-static suballocator_t* _pool4  = NULL;
-
-static int _initialised = 0;
-static seL4_Word _pool_base = 0;
-
-#define PRIMARY_POOL_SIZEBITS 14
-#define PRIMARY_POOL          _pool14
+/* Free blocks of each size, and a bit for each list that is not empty */
+static ut_block_t* _free[UT_MAX_SIZEBITS + 1];
+static uint32_t _free_sizes = 0;
 
+static ut_block_t** _hash = NULL;
+static int _hash_bits;
+static int _hash_count = 0;
 
-/*********************
- *** bitfield pool ***
- *********************/
+/* Nodes no longer describing a free block, kept for the next split */
+static ut_block_t* _spare = NULL;
 
-static void _bitfield_fill_pool(bitfield_t* bf, int sizebits){
-    if(sizebits != PRIMARY_POOL_SIZEBITS){
-        int offset;
+static int _initialised = 0;
 
-        /* grab a slab from the highest pool */
-        offset = bf_set_next_free(PRIMARY_POOL);
-        if(offset != -1){
-            int units;
-            int i;
 
-            offset <<= (PRIMARY_POOL_SIZEBITS - sizebits);
-            units = (1 << (PRIMARY_POOL_SIZEBITS - sizebits));
-            for(i = 0; i < units; i++){
-                bf_clr(bf, offset + i);
-            }
-        }
+/*******************
+ *** Block nodes ***
+ *******************/
 
-        /* Set the next free offset to improve search efficiency */
-        bf->next_free = offset;
-    }else{
-        /* We have no higher pool to fill from */
-    }
+static inline int _hash_index(seL4_Word addr, int sizebits, int hash_bits){
+    seL4_Word key = (addr >> sizebits) ^ sizebits;
+    return (key ^ (key >> hash_bits)) & (BIT(hash_bits) - 1);
 }
 
-static void _bitfield_merge_up(bitfield_t* pool, int sizebits, int offset){
-    if(sizebits != PRIMARY_POOL_SIZEBITS){
-        int primary_base;
-        int sublevel_base;
-        int sublevel_units;
-        int i;
-
-        /* Find the number of offsets covered and align to the starting offset */
-        sublevel_units = 1 << (PRIMARY_POOL_SIZEBITS - sizebits);
-        sublevel_base = offset & ~(sublevel_units - 1);
-        primary_base = sublevel_base >> (PRIMARY_POOL_SIZEBITS - sizebits);
-
-        /* Check if all offsets are free */
-        for(i = 0; i < sublevel_units; i++){
-            if(bf_get(pool, sublevel_base + i)){
-                /* Cannot merge */
-                return;
-            }
-        }
+/*
+ * Doubles the number of buckets. If there is no memory for them, we
+ * carry on with longer chains.
+ */
+static void _hash_grow(void){
+    int bits = _hash_bits + 1;
+    ut_block_t** hash;
+    int i;
 
-        /* Merge back to primary pool */
-        for(i = 0; i < sublevel_units; i++){
-            bf_set(pool, sublevel_base + i);
+    hash = (ut_block_t**)calloc(BIT(bits), sizeof(ut_block_t*));
+    if(hash == NULL){
+        return;
+    }
+    for(i = 0; i < BIT(_hash_bits); i++){
+        while(_hash[i] != NULL){
+            ut_block_t* b = _hash[i];
+            int j = _hash_index(b->addr, b->sizebits, bits);
+            _hash[i] = b->hash_next;
+            b->hash_next = hash[j];
+            hash[j] = b;
         }
-        bf_clr(PRIMARY_POOL, primary_base);
-
-    }else{
-        /* We have no higher pool to merge to */
     }
+    free(_hash);
+    _hash = hash;
+    _hash_bits = bits;
 }
 
-
-static seL4_Word do_ut_alloc_from_bitfield(int sizebits){
-    seL4_Word addr;
-    int offset;
-    bitfield_t* pool;
-
-    /* Select the appropriate pool */
-    switch(sizebits){
-    case 14: 
-        pool = _pool14;
-        break;
-    case 12:
-        pool = _pool12;
-        break;
-    case 10:
-        pool = _pool10;
-        break;
-    default:
-        /* invalid size */
-        assert(!"Invalid size");
-        return 0;
-    }
-
-    /* Allocate, fill as needed */
-    offset = bf_set_next_free(pool);
-    if(offset == -1){
-        _bitfield_fill_pool(pool, sizebits);
-        offset = bf_set_next_free(pool);
+static ut_block_t* _block_new(void){
+    ut_block_t* b = _spare;
+    if(b != NULL){
+        _spare = b->next;
+        return b;
     }
-
-    /* Translate the bitfield offset into an address */
-    if(offset == -1){
-        addr = 0;
-    }else{
-        addr = (offset << sizebits) + _pool_base;
-    }
-
-    return addr;
+    return (ut_block_t*)malloc(sizeof(ut_block_t));
 }
 
-static void do_ut_free_from_bitfield(seL4_Word addr, int sizebits){
-    int offset;
-    bitfield_t* pool;
-
-    /* Select the correct pool */
-    switch(sizebits){
-    case 14:
-        pool = _pool14;
-        break;
-    case 12:
-        pool = _pool12;
-        break;
-    case 10:
-        pool = _pool10;
-        break;
-    default:
-        /* invalid size */
-        assert(!"Invalid size");
-        return;
-    }
-
-    /* find the bitfield offset from the address */
-    offset = (addr - _pool_base) >> sizebits;
-    bf_clr(pool, offset);
-
-    /* Merge the freed memory back up to the primary pool if we can */
-    _bitfield_merge_up(pool, sizebits, offset);
-
+static void _block_release(ut_block_t* b){
+    b->next = _spare;
+    _spare = b;
 }
 
-/************************
- *** linked list pool ***
- ************************/
-static void _pool_list_detach(suballocator_t* node){
-    suballocator_t* next;
+/* Makes sure there are n spare nodes, so that a split cannot fail */
+static int _block_reserve(int n){
+    ut_block_t* b;
+    int have = 0;
 
-    assert(node != NULL);
-    assert(*node->prev != NULL);
-
-    /* Update next node */
-    next = node->next;
-    if(next){
-        next->prev = node->prev;
+    for(b = _spare; b != NULL && have < n; b = b->next){
+        have++;
     }
-
-    /* update previous node */
-    *node->prev = node->next;
-
-    /* Clear the internal links */
-    node->prev = NULL;
-    node->next = NULL;
-}
-
-static void _pool_list_attach(suballocator_t** pool, suballocator_t* node){
-    assert(node);
-    assert(node->next == NULL);
-    assert(node->prev == NULL);
-
-    /* Link to next */
-    node->next = *pool;
-    if(node->next){
-        node->next->prev = &node->next;
+    while(have < n){
+        b = (ut_block_t*)malloc(sizeof(ut_block_t));
+        if(b == NULL){
+            return !0;
+        }
+        _block_release(b);
+        have++;
     }
-
-    /* link to prev */
-    node->prev = pool;
-    *pool = node;
+    return 0;
 }
 
+static void _block_insert(ut_block_t* b, seL4_Word addr, int sizebits){
+    ut_block_t** list = &_free[sizebits];
+    int i;
 
+    b->addr = addr;
+    b->sizebits = sizebits;
 
-static suballocator_t* _pool_list_find_base(suballocator_t* pool, seL4_Word base){
-    while(pool != NULL){
-        if(pool->base == base){
-            return pool;
-        }
-
-        pool = pool->next;
+    /* Link to the free list */
+    b->next = *list;
+    if(b->next){
+        b->next->prev = &b->next;
     }
-    return NULL;
-}
+    b->prev = list;
+    *list = b;
+    _free_sizes |= BIT(sizebits);
 
-static suballocator_t* _pool_list_find_free(suballocator_t* pool){
-    while(pool != NULL){
-        if(pool->bitfield->available != 0){
-            return pool;
-        }
-
-        pool = pool->next;
+    /* and to the hash */
+    if(++_hash_count > 2 * BIT(_hash_bits)){
+        _hash_grow();
     }
-    return NULL;
+    i = _hash_index(addr, sizebits, _hash_bits);
+    b->hash_next = _hash[i];
+    _hash[i] = b;
 }
 
-static suballocator_t* _new_suballocator(int sizebits){
-    suballocator_t* pool_node;
-    seL4_Word primary_addr;
-    int units;
-
-    /* Reserve memory from the primary pool */
-    primary_addr = do_ut_alloc_from_bitfield(PRIMARY_POOL_SIZEBITS);
-    if(primary_addr == 0){
-        return NULL;
-    }
+static void _block_remove(ut_block_t* b){
+    ut_block_t** pp = &_hash[_hash_index(b->addr, b->sizebits, _hash_bits)];
 
-    /* create the pool node */
-    units = 1 << (PRIMARY_POOL_SIZEBITS - sizebits);
-    pool_node = (suballocator_t*)malloc(sizeof(suballocator_t));
-    if(pool_node == NULL){
-        do_ut_free_from_bitfield(primary_addr, PRIMARY_POOL_SIZEBITS);
-        return NULL;
+    /* Unlink from the free list */
+    if(b->next){
+        b->next->prev = b->prev;
     }
-    pool_node->base = primary_addr;
-    pool_node->next = NULL;
-    pool_node->prev = NULL;
-
-    /* Create the bitfield */
-    pool_node->bitfield = new_bitfield(units, BITFIELD_INIT_EMPTY);
-    if(pool_node->bitfield == NULL){
-        free(pool_node);
-        do_ut_free_from_bitfield(primary_addr, PRIMARY_POOL_SIZEBITS);
-        return NULL;
+    *b->prev = b->next;
+    if(_free[b->sizebits] == NULL){
+        _free_sizes &= ~BIT(b->sizebits);
     }
 
-    return pool_node;
-}
-
-static seL4_Word do_ut_alloc_from_list(int sizebits){
-    suballocator_t **pool;
-    suballocator_t *pool_node;
-    seL4_Word addr;
-    int offset;
-
-    /* Acquire the correct pool */
-    if(sizebits == 9){
-        pool = &_pool9;
-    }else if(sizebits == 4){
-        pool = &_pool4;
-    }else{
-        assert(!"Invalid size");
-        return 0;
-    }
-
-    /* Find a node in the list that we can use -- or create a new one */
-    pool_node = _pool_list_find_free(*pool);
-    if(pool_node == NULL){
-        pool_node = _new_suballocator(sizebits);
-        if(pool_node == NULL){
-            return 0;
-        }
-        _pool_list_attach(pool, pool_node);
+    /* and from the hash */
+    while(*pp != b){
+        assert(*pp != NULL);
+        pp = &(*pp)->hash_next;
     }
-
-    /* Allocate from the pool */
-    offset = bf_set_next_free(pool_node->bitfield);
-    assert(offset != -1);
-
-    addr = (offset << sizebits) + pool_node->base;
-
-    return addr;
+    *pp = b->hash_next;
+    _hash_count--;
 }
 
-static void do_ut_free_from_list(seL4_Word addr, int sizebits){
-    suballocator_t *pool;
-    suballocator_t *pool_node;
-    seL4_Word base;
-    int offset;
-    int units;
-
-    /* Acquire the correct pool */
-    if(sizebits == 9){
-        pool = _pool9;
-    }else if(sizebits == 4){
-        pool = _pool4;
-    }else{
-        assert(!"Invalid size");
-        return;
-    }
-
-    base = addr & ~((1 << PRIMARY_POOL_SIZEBITS) - 1);
-    offset = (addr - base) >> sizebits;
-    units = 1 << (PRIMARY_POOL_SIZEBITS - sizebits);
-
-    /* Find the pool node that matches the base address */
-    pool_node = _pool_list_find_base(pool, base);
-    assert(pool_node);
-
-    /* Clear memory and free pool node if empty */
-    bf_clr(pool_node->bitfield, offset);
-    if(pool_node->bitfield->available == units){
-        _pool_list_detach(pool_node);
-        do_ut_free_from_bitfield(pool_node->base, PRIMARY_POOL_SIZEBITS);
-        destroy_bitfield(pool_node->bitfield);
-        free(pool_node);
+static ut_block_t* _block_find(seL4_Word addr, int sizebits){
+    ut_block_t* b = _hash[_hash_index(addr, sizebits, _hash_bits)];
+    while(b != NULL && (b->addr != addr || b->sizebits != sizebits)){
+        b = b->hash_next;
     }
+    return b;
 }
 
+/*
+ * The largest block that can hold an address without reaching into the
+ * next untyped object
+ */
+static int _max_sizebits(seL4_Word addr){
+    int sizebits = ut_size_bits(addr);
+    assert(sizebits > 0);
+    return MIN(sizebits, UT_MAX_SIZEBITS);
+}
 
 
 /**************************
  *** Exported functions ***
  **************************/
 void ut_allocator_init(seL4_Word low, seL4_Word high){
-    seL4_Word mem_size;
-    int i;
+    seL4_Word addr;
 
     assert(!_initialised);
 
-    /* Align memory bounds */
-    low = FLOOR14(low);
-    high = CEILING14(high);
-
-    mem_size = high - low;
+    low = ROUND_UP(low, BIT(UT_MIN_SIZEBITS));
+    high = ROUND_DOWN(high, BIT(UT_MIN_SIZEBITS));
 
-    _pool_base = low;
-    _pool14 = new_bitfield(mem_size >> 14, BITFIELD_INIT_FILLED);
-    _pool12 = new_bitfield(mem_size >> 12, BITFIELD_INIT_FILLED);
-    _pool10 = new_bitfield(mem_size >> 10, BITFIELD_INIT_FILLED);
-
-    /* Marked untyped as available */
-    for(i = 0; i < mem_size >> 14; i++){
-        bf_clr(_pool14, i);
+    /* Size the hash for the memory we manage */
+    _hash_bits = UT_HASH_MIN_BITS;
+    while(_hash_bits + UT_HASH_SPAN_BITS < 31 &&
+          BIT(_hash_bits + UT_HASH_SPAN_BITS) < high - low){
+        _hash_bits++;
     }
+    _hash = (ut_block_t**)calloc(BIT(_hash_bits), sizeof(ut_block_t*));
+    conditional_panic(_hash == NULL, "No memory for the untyped allocator");
+
+    /* Carve memory into the largest blocks that stay aligned, within
+     * bounds and within a single untyped object */
+    addr = low;
+    while(addr < high){
+        ut_block_t* b;
+        int sizebits;
+
+        sizebits = _max_sizebits(addr);
+        if(addr != 0){
+            sizebits = MIN(sizebits, CTZ(addr));
+        }
+        while(addr + BIT(sizebits) > high){
+            sizebits--;
+        }
 
-    /* Initialise sub allocators */
-    _pool9 = NULL;
-    _pool4 = NULL;
+        b = _block_new();
+        conditional_panic(b == NULL, "No memory for the untyped allocator");
+        _block_insert(b, addr, sizebits);
+        addr += BIT(sizebits);
+    }
 
     _initialised = 1;
 }
 
 seL4_Word ut_alloc(int sizebits){
+    ut_block_t* b;
     seL4_Word addr;
+    int found;
 
     assert(_initialised);
 
-    /* make sure that we are initialised */
-    assert(PRIMARY_POOL != NULL);
-
-    /* forward to appropriate functions */
-    switch(sizebits){
-    case 4:
-    case 9:
-        addr = do_ut_alloc_from_list(sizebits);
-        break;
-    case 10:
-    case 12:
-    case 14:
-        addr = do_ut_alloc_from_bitfield(sizebits);
-        break;
-    default:
-        assert(!"ut_free received invalid size");
+    if(sizebits < UT_MIN_SIZEBITS || sizebits > UT_MAX_SIZEBITS){
+        assert(!"ut_alloc received invalid size");
         return 0;
     }
 
+    /* The smallest free block that is large enough */
+    if((_free_sizes >> sizebits) == 0){
+        return 0;
+    }
+    found = CTZ(_free_sizes >> sizebits) + sizebits;
+    if(_block_reserve(found - sizebits)){
+        return 0;
+    }
+    b = _free[found];
+    _block_remove(b);
+    addr = b->addr;
+    _block_release(b);
+
+    /* Return the upper halves as we split it down to size */
+    while(found > sizebits){
+        found--;
+        _block_insert(_block_new(), addr + BIT(found), found);
+    }
+
     return addr;
 }
 
 void ut_free(seL4_Word addr, int sizebits){
+    ut_block_t* b;
+    int max_sizebits;
+
     assert(addr != 0);
-    assert((addr & ((1 << sizebits) - 1)) == 0 || !"Address not aligned");
-
-    /* forward to appropriate functions */
-    switch(sizebits){
-    case 4:
-    case 9:
-        do_ut_free_from_list(addr, sizebits);
-        break;
-    case 10:
-    case 12:
-    case 14:
-        do_ut_free_from_bitfield(addr, sizebits);
-        break;
-    default:
-        assert(!"ut_free received invalid size");
+    assert(sizebits >= UT_MIN_SIZEBITS && sizebits <= UT_MAX_SIZEBITS);
+    assert((addr & (BIT(sizebits) - 1)) == 0 || !"Address not aligned");
+
+    /* Merge with the buddy for as long as it is free */
+    max_sizebits = _max_sizebits(addr);
+    while(sizebits < max_sizebits){
+        ut_block_t* buddy = _block_find(addr ^ BIT(sizebits), sizebits);
+        if(buddy == NULL){
+            break;
+        }
+        _block_remove(buddy);
+        _block_release(buddy);
+        addr &= ~BIT(sizebits);
+        sizebits++;
     }
-}
-
-
 
+    b = _block_new();
+    if(b == NULL){
+        dprintf(0, "ut: no memory to free 0x%x (%d bits)\n", addr, sizebits);
+        return;
+    }
+    _block_insert(b, addr, sizebits);
+}
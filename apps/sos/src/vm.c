@@ -0,0 +1,426 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/**
+ * Page fault handling. Most faults are resolved immediately. A fault that
+ * has to wait for the pager (for a frame to be freed, for its own page to
+ * be read back, or for a writeback of its page to finish) saves the reply
+ * cap of the faulting thread and is completed from the pager's callbacks,
+ * so only that thread waits.
+ *
+ * SOS can also page in a process's memory, e.g. before cloning it. The
+ * pages are brought in as though the process had faulted on them, except
+ * that a continuation is woken instead of a reply cap being saved.
+ */
+#include <stdlib.h>
+#include <assert.h>
+
+#include <cspace/cspace.h>
+
+#include "vm.h"
+#include "cont.h"
+#include "frametable.h"
+#include "imagecache.h"
+#include "pager.h"
+#include "perf.h"
+
+#define verbose 0
+#include <sys/debug.h>
+#include <sys/panic.h>
+
+#define PAGESIZE              (1 << (seL4_PageBits))
+
+struct vm_fault_req {
+    addrspace_t* as;
+    seL4_Word vaddr;
+    int write;
+    int prio;                   /* of the faulting process */
+    int pid;                    /* for perf_record */
+    uint64_t start;
+    int frame;
+    seL4_CPtr reply_cap;        /* seL4_CapNull until the fault blocks */
+    struct cont* cont;          /* set instead for SOS's continuations */
+    int persistent;             /* on the heap */
+    struct vm_fault_req* next;
+};
+
+/* Faults waiting for a busy page, highest priority first */
+static struct vm_fault_req* _blocked = NULL;
+
+/*
+ * Queues a fault behind those of the same or higher priority
+ */
+static void
+_vm_block(struct vm_fault_req* f){
+    struct vm_fault_req** pp = &_blocked;
+
+    while(*pp != NULL && (*pp)->prio >= f->prio){
+        pp = &(*pp)->next;
+    }
+    f->next = *pp;
+    *pp = f;
+}
+
+/*
+ * Moves a fault request to the heap and saves the caller's reply cap so
+ * that it can be completed later. A continuation counts it as pending.
+ */
+static struct vm_fault_req*
+_vm_persist(struct vm_fault_req* f){
+    struct vm_fault_req* hf;
+
+    if(f->persistent){
+        return f;
+    }
+    hf = malloc(sizeof(*hf));
+    if(hf == NULL){
+        return NULL;
+    }
+    *hf = *f;
+    hf->persistent = 1;
+    /* Keeps the address space until the fault completes */
+    hf->as->faults++;
+    if(hf->cont != NULL){
+        hf->cont->pending++;
+        return hf;
+    }
+    hf->reply_cap = cspace_save_reply_cap(cur_cspace);
+    if(hf->reply_cap == CSPACE_NULL){
+        hf->as->faults--;
+        free(hf);
+        return NULL;
+    }
+    return hf;
+}
+
+/*
+ * Completes a persisted fault, restarting the thread on success.
+ * A thread that made an invalid access is left blocked.
+ */
+static void
+_vm_finish(struct vm_fault_req* f, int err){
+    if(--f->as->faults == 0){
+        /* as_destroy may be waiting for the last one */
+        cont_wake(&f->as->destroy);
+    }
+    if(f->cont != NULL){
+        if(err){
+            f->cont->err = 1;
+        }
+        f->cont->pending--;
+        cont_wake(f->cont);
+        free(f);
+        return;
+    }
+    perf_record(SOS_PERF_VM_FAULT, f->pid, f->start);
+    if(!err){
+        seL4_Send(f->reply_cap, seL4_MessageInfo_new(0, 0, 0, 0));
+    }else{
+        dprintf(0, "vm_fault: unable to resolve fault at 0x%08x\n", f->vaddr);
+    }
+    cspace_free_slot(cur_cspace, f->reply_cap);
+    free(f);
+}
+
+/* The image cache slot for the page at vaddr in a shared region */
+#define SHARED_FRAME(region, vaddr) \
+    ((region)->shared->frames[((vaddr) - (region)->vbase) >> seL4_PageBits])
+
+/*
+ * Maps a frame at the faulting address. If fill is set this is the first
+ * touch of the page, so initialise it from the region's backing data.
+ * The first process to touch a page of a shared region loads it into
+ * the image cache for everyone else.
+ */
+static int
+_vm_map(struct vm_fault_req* f, int frame, int fill){
+    region_t* region;
+    pte_t* pte;
+    int err;
+
+    region = as_find_region(f->as, f->vaddr);
+    assert(region != NULL);
+    pte = as_lookup_pte(f->as, f->vaddr, 0);
+    if(pte != NULL && pte->cap != seL4_CapNull){
+        if(pte->cow && f->write){
+            /* This frame becomes our private copy */
+            return as_break_cow(f->as, f->vaddr, pte, frame, region->rights);
+        }
+        /* Someone else brought the page in while we waited */
+        frame_free(frame);
+        return 0;
+    }
+    if(region->shared != NULL){
+        if(SHARED_FRAME(region, f->vaddr) == FRAME_INVALID){
+            as_fill_page(region, f->vaddr, frame);
+            SHARED_FRAME(region, f->vaddr) = frame;
+        }else{
+            frame_free(frame);
+        }
+        return as_map_shared_frame(f->as, f->vaddr,
+                                   SHARED_FRAME(region, f->vaddr));
+    }
+    if(fill){
+        as_fill_page(region, f->vaddr, frame);
+    }
+    err = as_map_frame(f->as, f->vaddr, frame, region->rights);
+    if(err){
+        frame_free(frame);
+    }
+    return err;
+}
+
+static void
+_vm_pagein_cb(uintptr_t token, int err){
+    struct vm_fault_req* f = (struct vm_fault_req*)token;
+
+    if(err){
+        frame_free(f->frame);
+        _vm_finish(f, err);
+        return;
+    }
+    if(f->write){
+        /* Don't map it read only just to fault again */
+        frame_mark_dirty(f->frame);
+    }
+    _vm_finish(f, _vm_map(f, f->frame, 0));
+}
+
+static void
+_vm_frame_cb(uintptr_t token, int frame){
+    struct vm_fault_req* f = (struct vm_fault_req*)token;
+    pte_t* pte;
+
+    if(frame == FRAME_INVALID){
+        _vm_finish(f, !0);
+        return;
+    }
+    pte = as_lookup_pte(f->as, f->vaddr, 0);
+    if(pte != NULL && pte->swapped){
+        f->frame = frame;
+        if(pager_pagein(frame, pte, f->prio, _vm_pagein_cb, token)){
+            frame_free(frame);
+            _vm_finish(f, !0);
+        }
+        return;
+    }
+    _vm_finish(f, _vm_map(f, frame, 1));
+}
+
+/*
+ * Attempts to resolve a fault. *fp is updated if the request had to be
+ * persisted, in which case the result must be delivered via _vm_finish
+ * unless VM_FAULT_PENDING is returned.
+ */
+static int
+_vm_try(struct vm_fault_req** fp){
+    struct vm_fault_req* f = *fp;
+    region_t* region;
+    pte_t* pte;
+    int frame;
+
+    region = as_find_region(f->as, f->vaddr);
+    if(region == NULL){
+        dprintf(0, "vm_fault: 0x%08x is not in any region\n", f->vaddr);
+        return !0;
+    }
+    if(f->write && !(region->rights & seL4_CanWrite)){
+        dprintf(0, "vm_fault: write to read only address 0x%08x\n", f->vaddr);
+        return !0;
+    }
+
+    pte = as_lookup_pte(f->as, f->vaddr, 0);
+    if(pte != NULL && pte->busy){
+        /* Wait for the pager to finish with the page and try again */
+        f = *fp = _vm_persist(f);
+        if(f == NULL){
+            return !0;
+        }
+        _vm_block(f);
+        return VM_FAULT_PENDING;
+    }
+    if(pte != NULL && pte->cap != seL4_CapNull){
+        if(pte->cow && f->write){
+            /* Copy on write. Keep the frame if nobody else has it */
+            if(frame_refcount(pte->frame) == 1){
+                return as_break_cow(f->as, f->vaddr, pte, FRAME_INVALID,
+                                    region->rights);
+            }
+            frame = frame_alloc_async(NULL, 0, f->prio);
+            if(frame != FRAME_INVALID){
+                return as_break_cow(f->as, f->vaddr, pte, frame,
+                                    region->rights);
+            }
+        }else if(!pte->mapped){
+            /* Unmapped by the clock hand, or write protected for copy on
+             * write; this marks it referenced again */
+            if(f->write && !pte->cow){
+                frame_mark_dirty(pte->frame);
+            }
+            return as_remap_page(f->as, f->vaddr, pte,
+                                 pte->cow ? seL4_CanRead : region->rights);
+        }else if(f->write && !pte->cow && !pte->shared && !pte->device){
+            /* Mapped read only while the pagefile held a copy, which is
+             * about to go stale */
+            frame_mark_dirty(pte->frame);
+            seL4_ARM_Page_Unmap(pte->cap);
+            pte->mapped = 0;
+            return as_remap_page(f->as, f->vaddr, pte, region->rights);
+        }else{
+            /* The page is resident, so this was a genuine protection fault */
+            dprintf(0, "vm_fault: protection fault at 0x%08x\n", f->vaddr);
+            return !0;
+        }
+    }else if(region->shared != NULL){
+        frame = SHARED_FRAME(region, f->vaddr);
+        if(frame != FRAME_INVALID){
+            /* Already loaded by another instance of the program */
+            return as_map_shared_frame(f->as, f->vaddr, frame);
+        }
+    }
+
+    if(!f->write && region->shared == NULL &&
+       (pte == NULL || (pte->cap == seL4_CapNull && !pte->swapped)) &&
+       as_page_is_zero(region, f->vaddr)){
+        /* Reads of untouched anonymous memory share the zero frame */
+        return as_map_zero(f->as, f->vaddr);
+    }
+
+    if(pte == NULL || (pte->cap == seL4_CapNull && !pte->swapped)){
+        /* Fast path: a fresh zero page from free memory */
+        frame = frame_alloc_async(NULL, 0, f->prio);
+        if(frame != FRAME_INVALID){
+            return _vm_map(f, frame, 1);
+        }
+    }
+
+    /* Slow path: we have to wait for the pager */
+    f = *fp = _vm_persist(f);
+    if(f == NULL){
+        return !0;
+    }
+    frame = frame_alloc_async(_vm_frame_cb, (uintptr_t)f, f->prio);
+    if(frame == FRAME_INVALID){
+        dprintf(0, "vm_fault: out of memory\n");
+        return !0;
+    }
+    if(frame != FRAME_PENDING){
+        _vm_frame_cb((uintptr_t)f, frame);
+    }
+    return VM_FAULT_PENDING;
+}
+
+int
+vm_fault(addrspace_t* as, seL4_Word vaddr, int write, int prio, int pid){
+    struct vm_fault_req req;
+    struct vm_fault_req* f = &req;
+    int err;
+
+    req.as = as;
+    req.vaddr = vaddr;
+    req.write = write;
+    req.prio = prio;
+    req.pid = pid;
+    req.start = perf_start();
+    req.frame = FRAME_INVALID;
+    req.reply_cap = seL4_CapNull;
+    req.cont = NULL;
+    req.persistent = 0;
+    req.next = NULL;
+
+    err = _vm_try(&f);
+    if(f != &req && err != VM_FAULT_PENDING){
+        /* The reply cap has been saved, so we must reply through it */
+        _vm_finish(f, err);
+        return err ? err : VM_FAULT_PENDING;
+    }
+    if(err != VM_FAULT_PENDING){
+        perf_record(SOS_PERF_VM_FAULT, pid, req.start);
+    }
+    return err;
+}
+
+void
+vm_retry_blocked(void){
+    /* In priority order, so the most urgent get the free frames first */
+    struct vm_fault_req* list = _blocked;
+
+    _blocked = NULL;
+    while(list != NULL){
+        struct vm_fault_req* f = list;
+        int err;
+
+        list = f->next;
+        err = _vm_try(&f);
+        if(err != VM_FAULT_PENDING){
+            _vm_finish(f, err);
+        }
+    }
+}
+
+/*
+ * Starts reading a swapped out page back in on behalf of a continuation
+ * @return 0 if the read was started or the page was resolved at once
+ */
+static int
+_vm_page_in(addrspace_t* as, seL4_Word vaddr, struct cont* c){
+    struct vm_fault_req req;
+    struct vm_fault_req* f = &req;
+    int err;
+
+    req.as = as;
+    req.vaddr = vaddr;
+    req.write = 0;
+    req.prio = c->prio;
+    req.pid = 0;
+    req.start = 0;
+    req.frame = FRAME_INVALID;
+    req.reply_cap = seL4_CapNull;
+    req.cont = c;
+    req.persistent = 0;
+    req.next = NULL;
+
+    err = _vm_try(&f);
+    if(f != &req && err != VM_FAULT_PENDING){
+        /* Counted as pending, so it must be completed */
+        _vm_finish(f, err);
+        return err;
+    }
+    return (err == VM_FAULT_PENDING) ? 0 : err;
+}
+
+int
+vm_page_in_all(addrspace_t* as, struct cont* c){
+    region_t* r;
+    int waiting = 0;
+
+    for(r = as->regions; r != NULL; r = r->next){
+        seL4_Word vaddr;
+
+        for(vaddr = r->vbase; vaddr < r->vend; vaddr += PAGESIZE){
+            pte_t* pte = as_lookup_pte(as, vaddr, 0);
+            if(pte == NULL){
+                /* Skip the rest of the unused second level table */
+                vaddr |= (1 << (seL4_PageBits + AS_L2_BITS)) - PAGESIZE;
+                continue;
+            }
+            if(pte->busy){
+                /* The pager wakes us when it is done with the page */
+                waiting = 1;
+            }else if(pte->cap == seL4_CapNull && pte->swapped){
+                if(_vm_page_in(as, vaddr, c)){
+                    return !0;
+                }
+                waiting = 1;
+            }
+        }
+    }
+    return waiting ? VM_FAULT_PENDING : 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#ifndef _VM_H_
+#define _VM_H_
+
+#include <sel4/sel4.h>
+
+#include "addrspace.h"
+
+struct cont;
+
+/* Write not Read bit of the ARM data fault status register */
+#define FSR_WNR             (1 << 11)
+
+/* Returned by vm_fault when the fault will be resolved later */
+#define VM_FAULT_PENDING    (-1)
+
+/**
+ * Resolves a page fault by allocating and mapping a frame, reading the
+ * page back from the pagefile if required.
+ * @pre the faulting thread must be the caller of the last received message
+ * @param as the address space of the faulting thread
+ * @param vaddr the faulting address
+ * @param write non zero if the fault was caused by a write
+ * @param prio the priority of the faulting process. Faults that have to
+ *        wait are served highest priority first.
+ * @param pid the faulting process, for the fault's perf_record
+ * @return 0 if the fault was resolved and the thread may be restarted,
+ *         VM_FAULT_PENDING if the reply cap has been saved and the thread
+ *         will be restarted once I/O completes, or another non zero value
+ *         if the access was invalid or we are out of memory
+ */
+int vm_fault(addrspace_t* as, seL4_Word vaddr, int write, int prio,
+             int pid);
+
+/**
+ * Retries faults that were waiting for a busy page. Called by the pager
+ * whenever pagefile I/O for a page completes.
+ */
+void vm_retry_blocked(void);
+
+/**
+ * Starts bringing every paged out page of an address space back into
+ * memory for a continuation, which is woken as the pages arrive. Used
+ * before work that needs the whole address space resident, such as
+ * as_clone, without waiting for the pager.
+ * @param as the address space, which must not be running
+ * @param c the continuation to wake
+ * @return 0 if every page is resident, VM_FAULT_PENDING if the
+ *         continuation must wait and call this again, or another non
+ *         zero value if we are out of memory
+ */
+int vm_page_in_all(addrspace_t* as, struct cont* c);
+
+#endif /* _VM_H_ */
@@ -11,12 +11,22 @@
 #ifndef _MEM_LAYOUT_H_
 #define _MEM_LAYOUT_H_
 
+#include <sos_syscall.h>
+
 /* Address where memory used for DMA starts getting mapped.
  * Do not use the address range between DMA_VSTART and DMA_VEND */
 #define DMA_VSTART          (0x10000000)
 #define DMA_SIZE_BITS       (22)
 #define DMA_VEND            (DMA_VSTART + (1ull << DMA_SIZE_BITS))
 
+/* The frame table is mapped into SOS from this address onwards.
+ * It is sized at boot to cover all memory managed by ut_alloc */
+#define FRAME_TABLE_VSTART  (0x20000000)
+
+/* Every frame in the frame table is permanently mapped into SOS from
+ * this address onwards, indexed by frame number */
+#define FRAME_WINDOW        (0x30000000)
+
 /* From this address onwards is where any devices will get mapped in
  * by the map_device function. You should not use any addresses beyond
  * here without first modifying map_device */
@@ -27,10 +37,13 @@
 /* Constants for how SOS will layout the address space of any
  * processes it loads up */
 #define PROCESS_STACK_TOP   (0x90000000)
+#define PROCESS_STACK_SIZE  (0x01000000)
+#define PROCESS_HEAP_START  (0x20000000)   /* Must match libsos */
+#define PROCESS_HEAP_END    (0x30000000)
 #define PROCESS_IPC_BUFFER  (0xA0000000)
+#define PROCESS_IO_BUFFER   (SOS_IO_BUFFER)
+#define PROCESS_IO_SIZE     (SOS_IO_BUFFER_SIZE)
 #define PROCESS_VMEM_START  (0xC0000000)
 
-#define PROCESS_SCRATCH     (0xD0000000)
-
 
 #endif /* _MEM_LAYOUT_H_ */
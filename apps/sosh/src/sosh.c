@@ -23,6 +23,7 @@
 
 /* Your OS header file */
 #include <sos.h>
+#include <sos_syscall.h>
 
 #define BUF_SIZ   128
 #define MAX_ARGS   32
@@ -132,14 +133,21 @@ static int exec(int argc, char **argv) {
     pid_t pid;
     int r;
     int bg = 0;
-
-    if (argc < 2 || (argc > 2 && argv[2][0] != '&')) {
-        printf("Usage: exec filename [&]\n");
-        return 1;
+    int prio = -1;
+    int i;
+
+    for (i = 2; i < argc; i++) {
+        if (argv[i][0] == '&' && !bg) {
+            bg = 1;
+        } else if (argv[i][0] >= '0' && argv[i][0] <= '9' && prio < 0) {
+            prio = atoi(argv[i]);
+        } else {
+            break;
+        }
     }
-
-    if ((argc > 2) && (argv[2][0] == '&')) {
-        bg = 1;
+    if (argc < 2 || i < argc) {
+        printf("Usage: exec filename [priority] [&]\n");
+        return 1;
     }
 
     if (bg == 0) {
@@ -147,7 +155,11 @@ static int exec(int argc, char **argv) {
         assert(r == 0);
     }
 
-    pid = sos_process_create(argv[1]);
+    if (prio < 0) {
+        pid = sos_process_create(argv[1]);
+    } else {
+        pid = sos_process_create_prio(argv[1], prio);
+    }
     if (pid >= 0) {
         printf("Child pid=%d\n", pid);
         if (bg == 0) {
@@ -239,6 +251,78 @@ static int micro_time(int argc, char *argv[]) {
     return 0;
 }
 
+/* Recent events shown by perf */
+#define PERF_SHOW_EVENTS 16
+
+static const char *perf_kind_name(int kind) {
+    static const char *names[] = {
+        "null", "1", "create", "clone", "open", "close", "read", "write",
+        "ring_setup", "ring_enter", "perf"
+    };
+    static char buf[8];
+
+    if (kind == SOS_PERF_VM_FAULT) {
+        return "vm_fault";
+    } else if (kind == SOS_PERF_IRQ) {
+        return "irq";
+    } else if (kind < sizeof(names) / sizeof(*names)) {
+        return names[kind];
+    }
+    snprintf(buf, sizeof(buf), "%d", kind);
+    return buf;
+}
+
+static int perf(int argc, char **argv) {
+    static struct sos_perf p;
+    unsigned int n, first;
+    int kind, b;
+
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "clear") != 0)) {
+        printf("Usage: perf [clear]\n");
+        return 1;
+    }
+    if (sos_perf_read(&p, argc == 2) != 0) {
+        printf("Failed!\n");
+        return 1;
+    }
+
+    /* One line per kind of event: the count under each power of two */
+    printf("%-10s %8s  latency (us): count\n", "event", "total");
+    for (kind = 0; kind < SOS_PERF_KINDS; kind++) {
+        unsigned int total = 0;
+
+        for (b = 0; b < SOS_PERF_BUCKETS; b++) {
+            total += p.hist[kind][b];
+        }
+        if (total == 0) {
+            continue;
+        }
+        printf("%-10s %8u ", perf_kind_name(kind), total);
+        for (b = 0; b < SOS_PERF_BUCKETS; b++) {
+            if (p.hist[kind][b] == 0) {
+                continue;
+            }
+            if (b == SOS_PERF_BUCKETS - 1) {
+                printf(" >=%u:%u", 1u << (b - 1), p.hist[kind][b]);
+            } else {
+                printf(" <%u:%u", 1u << b, p.hist[kind][b]);
+            }
+        }
+        printf("\n");
+    }
+
+    n = (p.nevents < PERF_SHOW_EVENTS) ? p.nevents : PERF_SHOW_EVENTS;
+    first = p.nevents - n;
+    printf("\nlast %u of %u events:\n", n, p.nevents);
+    printf("%10s %4s %-10s %8s\n", "start", "pid", "event", "us");
+    for (; first < p.nevents; first++) {
+        struct sos_perf_event *e = &p.events[first % SOS_PERF_EVENTS];
+        printf("%10u %4u %-10s %8u\n", e->start, e->pid,
+               perf_kind_name(e->kind), e->usecs);
+    }
+    return 0;
+}
+
 struct command {
     char *name;
     int (*command)(int argc, char **argv);
@@ -246,7 +330,7 @@ struct command {
 
 struct command commands[] = { { "dir", dir }, { "ls", dir }, { "cat", cat }, {
         "cp", cp }, { "ps", ps }, { "exec", exec }, {"sleep",second_sleep}, {"msleep",milli_sleep},
-        {"time", second_time}, {"mtime", micro_time} };
+        {"time", second_time}, {"mtime", micro_time}, {"perf", perf} };
 
 int main(void) {
     char buf[BUF_SIZ];
@@ -19,11 +19,14 @@
  *
  ****************************************************************************/
 
+#include <autoconf.h>
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <sel4/sel4.h>
+#include <sos_syscall.h>
 
 
 #include "ttyout.h"
@@ -38,10 +41,69 @@ thread_block(void){
     seL4_Call(SYSCALL_ENDPOINT_SLOT, tag);
 }
 
+#ifdef CONFIG_APP_TTY_TEST_SYSCALL_BENCH
+#define BENCH_WARMUP    16
+#define BENCH_RUNS      1000
+
+static inline uint32_t
+read_ccnt(void){
+    uint32_t v;
+    asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(v));
+    return v;
+}
+
+// Start the cycle counter; the kernel lets us at the PMU
+static void
+ccnt_init(void){
+    uint32_t v;
+    asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r"(v));
+    v |= (1 << 0) | (1 << 2);   /* enable, reset cycle counter */
+    asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r"(v));
+    v = (1 << 31);              /* cycle counter enable */
+    asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r"(v));
+}
+
+static void
+null_syscall(void){
+    seL4_MessageInfo_t tag = seL4_MessageInfo_new(0, 0, 0, 1);
+    seL4_SetMR(0, SOS_SYSCALL_NULL);
+    seL4_Call(SYSCALL_ENDPOINT_SLOT, tag);
+}
+
+// Time the round trip of the cheapest system call
+static void
+syscall_bench(void){
+    uint32_t min = UINT32_MAX;
+    uint64_t total = 0;
+    int i;
+
+    ccnt_init();
+    for (i = 0; i < BENCH_WARMUP; i++) {
+        null_syscall();
+    }
+    for (i = 0; i < BENCH_RUNS; i++) {
+        uint32_t start = read_ccnt();
+        uint32_t t;
+        null_syscall();
+        t = read_ccnt() - start;
+        total += t;
+        if (t < min) {
+            min = t;
+        }
+    }
+    printf("task:\tSOS_SYSCALL0 round trip: %u cycles min, %u mean (%d calls)\n",
+           (unsigned)min, (unsigned)(total / BENCH_RUNS), BENCH_RUNS);
+}
+#endif
+
 int main(void){
     /* initialise communication */
     ttyout_init();
 
+#ifdef CONFIG_APP_TTY_TEST_SYSCALL_BENCH
+    syscall_bench();
+#endif
+
     do {
         printf("task:\tHello world, I'm\ttty_test!\n");
         thread_block();
@@ -59,6 +59,8 @@
 
 
 
+struct cspace_range_node;
+
 /**
  * A representation of a cspace_t. The Internals Should be opaque to users except for the two
  * variables documented, which a needed to initialise TCBs: root_cnode and guard.
@@ -71,7 +73,10 @@ typedef struct {
     seL4_Word addr;                 /* the physical address of the top level cnode */ 
     int32_t next_level1_free_index;   /* the next free slot in the top level cnode */
     int32_t next_level2_free_slot;   /* the next free slot in leaf cnodes */
+    int32_t next_level2_fresh_slot;  /* the next never used slot in the newest leaf cnode */
+    int32_t level2_fresh_end;        /* the end of that leaf cnode */
     uint32_t num_free_slots;    /* number of free slots, largely here for future use */
+    struct cspace_range_node *range_nodes; /* leaf cnodes handed out in contiguous ranges */
     uint32_t level1_alloc_table[CSPACE_NODE_SIZE_IN_SLOTS]; /*
 							     * Either: 
 							     *  - A list of free level 1 slots, or 
@@ -240,7 +245,8 @@ extern cspace_err_t cspace_root_task_bootstrap(cspace_ut_alloc_t ut_alloc,
  *  only to expose seL4_CPtr's valid in the specific cspace_t.
  *
  * The cspace is initialised such that there are free slots upon return. I.e. 1 or 2 cnodes are
- * allocated depending of the number of levels specified.
+ * allocated depending of the number of levels specified. A 2 level cspace then grows by a level 2
+ * cnode at a time whenever its free slots run out, up to CSPACE_NODE_SIZE_IN_SLOTS cnodes.
  */
 extern cspace_t * cspace_create(int levels); /* either 1 or 2 level */
 
@@ -252,9 +258,9 @@ extern cspace_t * cspace_create(int levels); /* either 1 or 2 level */
  *
  * @return Either CSPACE_ERROR or CSPACE_NOERROR
  *
- * The routine deletes the caps associated with the level 2 and level 1 cnodes that are associated
- * with this cspace. It also returns the untyped memory back to the untyped memory allocator and
- * frees any book keeping that may have been malloced.
+ * The routine deletes the cap to the level 1 cnode, which has the kernel delete every cap in the
+ * cspace including those to the level 2 cnodes, all in one call. It also returns the untyped memory
+ * back to the untyped memory allocator and frees any book keeping that may have been malloced.
  *
  * NOTE: The cnode deletion assumes the internal cnode caps have not been copied elsewhere, so that
  * deleting them here results in seL4 having free untyped memory. If the cnode caps have been
@@ -270,7 +276,7 @@ extern cspace_err_t cspace_destroy(cspace_t *c);
  *
  * @param c Specified cspace
  *
- * @return CSPACE_NULL on error.
+ * @return CSPACE_NULL on error, e.g. if a 2 level cspace cannot grow.
  *
  * This function reserves a slot in the specified cspace that can be used directly with seL4
  * operations. This function is not normally needed, but can be used for particular
@@ -301,6 +307,37 @@ extern seL4_CPtr cspace_alloc_slot(cspace_t *c);
 extern cspace_err_t cspace_free_slot(cspace_t *c, seL4_CPtr slot);
 
 
+/**
+ * Reserve a range of contiguous free slots in the specified cspace.
+ *
+ * @param c Specified cspace, which must have two levels
+ * @param n The number of slots, at most CSPACE_NODE_SIZE_IN_SLOTS
+ *
+ * @return The first slot of the range, or CSPACE_NULL on error.
+ *
+ * The range lies within a single leaf cnode and is aligned to n rounded up to a power of two, so
+ * that it can be the destination of a single seL4_Untyped_Retype creating n objects. Leaf cnodes
+ * used for ranges are kept apart from those used by cspace_alloc_slot, and are allocated as
+ * needed. The slots can be freed all at once with cspace_free_slots, or one at a time with
+ * cspace_free_slot or cspace_delete_cap.
+ */
+extern seL4_CPtr cspace_alloc_slots(cspace_t *c, int n);
+
+
+/**
+ * Return a range of slots back to the cspace slot allocator.
+ *
+ * @param c The cspace
+ * @param slot The first slot of the range
+ * @param n The number of slots
+ *
+ * @return Either CSPACE_ERROR or CSPACE_NOERROR
+ *
+ * Like cspace_free_slot, the slots are assumed to be empty.
+ */
+extern cspace_err_t cspace_free_slots(cspace_t *c, seL4_CPtr slot, int n);
+
+
 /**
  * Copy a capability from one cspace to the same or another cspace.
  *
@@ -499,7 +536,8 @@ libs/libsel4/arch_include/arm/sel4/arch/constants.h appropriate defines.
  * The function allocates a free slot in the destination cspace to place the capability to the new
  * object. It calls the cspace_ut_translate() (that is provided at bootstrap) to translate the given
  * physical address into a tuple of (untype cap CPtr, offset) to pass to seL4. It then calls to
- * create the object and obtain the capability.
+ * create the object and obtain the capability. On error, the slot is freed again and dest_cap is
+ * left untouched.
  *
  * Note: One should cspace_delete_cap() the cap to objects (and all copies of any caps made) in
  * order to return the memory used by the object to free untyped memory.
@@ -514,5 +552,26 @@ extern seL4_Error cspace_ut_retype_addr(seL4_Word address,
                                         cspace_t *dest,
                                         seL4_CPtr *dest_cap);
 
+/**
+ * Create a number of objects of the same type from untyped memory with a single kernel call.
+ *
+ * @param address The physical address of the first object. The n objects follow it contiguously.
+ * @param n The number of objects
+ * @param dest_cap Return the seL4_CPtr of the cap to the first object. The cap to object i is at
+ * dest_cap + i.
+ *
+ * @return seL4_NOERROR on success.
+ *
+ * As cspace_ut_retype_addr, except that a range of n slots is reserved with cspace_alloc_slots.
+ * The memory of all n objects must lie within one untyped object, which is the case if it was
+ * allocated as a single block of n objects. On error, the slots are freed.
+ */
+extern seL4_Error cspace_ut_retype_addrs(seL4_Word address,
+                                         seL4_Word type,
+                                         seL4_Word size_bits,
+                                         cspace_t *dest,
+                                         int n,
+                                         seL4_CPtr *dest_cap);
+
 
 #endif /* CSPACE_H */
@@ -74,6 +74,9 @@ cspace_err_t cspace_root_task_bootstrap(cspace_ut_alloc_t alloc_func,
     assert(space);
  
     space->levels = 2; /* root task cspace will be 2 levels */
+    space->next_level2_fresh_slot = 0;
+    space->level2_fresh_end = 0;
+    space->range_nodes = NULL;
     
     /* initialise the free level1 index list for list based allocation */
     for (i = 0; i < (CSPACE_NODE_SIZE_IN_SLOTS-1) ; i++) {
@@ -308,6 +311,9 @@ cspace_t *cspace_create(int levels) /* either 1 or 2 level */
     
     c = cspace_malloc(sizeof(cspace_t));
     assert(c != NULL);
+    c->next_level2_fresh_slot = 0;
+    c->level2_fresh_end = 0;
+    c->range_nodes = NULL;
     
     addr = cspace_ut_alloc(CSPACE_NODE_SIZE_IN_MEM_BITS);
     assert(addr != 0);
@@ -445,15 +451,16 @@ cspace_err_t cspace_destroy(cspace_t *c)
 
 
     int i;
-    seL4_Error serr;
 
     assert(cur_cspace != c); /* suicide is not supported */
     assert(cur_cspace != NULL);
     
     /*
-     * we don't do anything clever here:
-     *  * we delete the level2s (together with their allocation tables)
-     *  * then the level1
+     * The cap to the level 1 cnode is the last one, so deleting it has the kernel delete every cap
+     * in the cspace, including the caps to the level 2 cnodes, which are also the last ones. The
+     * whole cspace goes in a single call, however many slots are in use. Afterwards:
+     *  * we free the level2s' memory (together with their allocation tables)
+     *  * then the level1's
      *  * then cspace struct
      *
      *
@@ -462,22 +469,23 @@ cspace_err_t cspace_destroy(cspace_t *c)
      * they are really free or not.
      */
 
+    cspace_delete_cap(cur_cspace, c->root_cnode); /* expectation is that this is last cap to cnode */
 
     if (c->levels == 2) {
         for (i = 0; i < CSPACE_NODE_SIZE_IN_SLOTS; i++) {
             if (c->level2_alloc_tables[i] != NULL) {
-                /* delete the l2 cnode and the allocation table with it */
-                serr = seL4_CNode_Delete(c->root_cnode,
-                                         i,
-                                         CSPACE_DEPTH - CSPACE_NODE_SIZE_IN_SLOTS_BITS);
-                sel4_error(serr, "Deleting level-2 cnodes");
                 cspace_ut_free(c->level1_alloc_table[i], CSPACE_NODE_SIZE_IN_MEM_BITS);
                 cspace_free(c->level2_alloc_tables[i]);
             }
         }
+        while (c->range_nodes != NULL) {
+            struct cspace_range_node *node = c->range_nodes;
+            c->range_nodes = node->next;
+            cspace_ut_free(c->level1_alloc_table[node->l1index], CSPACE_NODE_SIZE_IN_MEM_BITS);
+            cspace_free(node);
+        }
     }
     
-    cspace_delete_cap(cur_cspace, c->root_cnode); /* expectation is that this is last cap to cnode */
     cspace_ut_free(c->addr,CSPACE_NODE_SIZE_IN_MEM_BITS); 
     
     cspace_free(c);
@@ -569,6 +577,27 @@ cspace_err_t cspace_free_slot(cspace_t *c, seL4_CPtr slot)
     return CSPACE_NOERROR;
 }
 
+seL4_CPtr cspace_alloc_slots(cspace_t *c, int n)
+{
+    assert(c != NULL);
+
+    if (c->levels != 2) {
+        return CSPACE_NULL; /* a single level cspace has no leaf cnodes to give out */
+    }
+    return cspace_alloc_level2_range(c, n);
+}
+
+cspace_err_t cspace_free_slots(cspace_t *c, seL4_CPtr slot, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        if (cspace_free_slot(c, slot + i) != CSPACE_NOERROR) {
+            return CSPACE_ERROR;
+        }
+    }
+    return CSPACE_NOERROR;
+}
+
 seL4_Error cspace_ut_retype_addr(seL4_Word addr,
                                  seL4_Word type,
                                  seL4_Word size_bits,
@@ -585,11 +614,10 @@ seL4_Error cspace_ut_retype_addr(seL4_Word addr,
     if (new == CSPACE_NULL) {
         return seL4_NotEnoughMemory; /* Nearest sane error */
     }
-    assert(p != NULL);
-    *p = new;
     
     err = cspace_ut_translate(addr, &ut_cptr,&offset);
     if(err){
+        cspace_free_slot(c, new);
         return err;
     }
 
@@ -615,6 +643,50 @@ seL4_Error cspace_ut_retype_addr(seL4_Word addr,
            err    
            );
 #endif
+    if (err) {
+        cspace_free_slot(c, new);
+        return err;
+    }
+    assert(p != NULL);
+    *p = new;
+    return err;
+}
+
+seL4_Error cspace_ut_retype_addrs(seL4_Word addr,
+                                  seL4_Word type,
+                                  seL4_Word size_bits,
+                                  cspace_t *c,
+                                  int n,
+                                  seL4_CPtr *p)
+{
+    seL4_CPtr ut_cptr; 
+    seL4_Word offset;
+    seL4_CPtr first;
+    seL4_Error err;
+
+    first = cspace_alloc_slots(c, n);
+    if (first == CSPACE_NULL) {
+        return seL4_NotEnoughMemory; /* Nearest sane error */
+    }
+    
+    err = cspace_ut_translate(addr, &ut_cptr, &offset);
+    if (!err) {
+        err = seL4_Untyped_RetypeAtOffset(ut_cptr, 
+                                          type,
+                                          offset,
+                                          size_bits,
+                                          c->root_cnode,
+                                          first >> CSPACE_NODE_SIZE_IN_SLOTS_BITS, /* First level index */
+                                          CSPACE_DEPTH - CSPACE_NODE_SIZE_IN_SLOTS_BITS, /* only go to first level */
+                                          first & (CSPACE_NODE_SIZE_IN_SLOTS -1), /* the index in the leaf node */
+                                          n);
+    }
+    if (err) {
+        cspace_free_slots(c, first, n);
+        return err;
+    }
+    assert(p != NULL);
+    *p = first;
     return err;
 }
 
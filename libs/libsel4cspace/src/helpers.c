@@ -50,72 +50,181 @@ cspace_err_t cspace_free_level1_index(cspace_t *c, int32_t s)
     return CSPACE_NOERROR;
 }
 
-seL4_CPtr cspace_alloc_level2_slot(cspace_t *c)
+int32_t cspace_alloc_level2_node(cspace_t *c)
 {
-    seL4_CPtr s, ut_cptr;
-    uint32_t i,j,offset,v;
-    seL4_CPtr l1;
+    seL4_CPtr ut_cptr;
+    uint32_t offset, v;
+    int32_t l1;
     cspace_err_t cerr;
     seL4_Error serr;
 
-    if (c->num_free_slots <= 0) {
-	/* allocate a new level 2 cnode here */        
-        l1 = cspace_alloc_level1_index(c);
-        assert(l1 != CSPACE_NOSLOT);
-        
-        v = cspace_ut_alloc(CSPACE_NODE_SIZE_IN_MEM_BITS);
-        assert (v != 0);
-        cerr = cspace_ut_translate(v, &ut_cptr, &offset);
-        assert (cerr == CSPACE_NOERROR);
-        c->level1_alloc_table[l1] = v; /* save the phys address for later free */
+    if (c->next_level1_free_index == CSPACE_NOSLOT) {
+        return CSPACE_NOINDEX; /* the level 1 cnode is full */
+    }
+    v = cspace_ut_alloc(CSPACE_NODE_SIZE_IN_MEM_BITS);
+    if (v == 0) {
+        return CSPACE_NOINDEX;
+    }
+    l1 = cspace_alloc_level1_index(c);
+    cerr = cspace_ut_translate(v, &ut_cptr, &offset);
+    assert (cerr == CSPACE_NOERROR);
+    c->level1_alloc_table[l1] = v; /* save the phys address for later free */
 
-        
-        serr = seL4_Untyped_RetypeAtOffset(ut_cptr,
-                                           seL4_CapTableObject,
-                                           offset,
-                                           CSPACE_NODE_SIZE_IN_SLOTS_BITS,
-                                           c->root_cnode,
-                                           0, 
-                                           0,
-                                           l1,
-                                           1);
-        assert(serr == seL4_NoError);
-        
-        for (j = (l1 << CSPACE_NODE_SIZE_IN_SLOTS_BITS), i = j >> CSPACE_NODE_SIZE_IN_SLOTS_BITS;
-             j < ((l1 +1) << CSPACE_NODE_SIZE_IN_SLOTS_BITS)-1;
-             j++) {
-            if ((j & (CSPACE_NODE_SIZE_IN_SLOTS -1)) == 0) {
-                i = j >> CSPACE_NODE_SIZE_IN_SLOTS_BITS;
-                c->level2_alloc_tables[i] = 
-                    cspace_malloc(sizeof(uint32_t)*CSPACE_NODE_SIZE_IN_SLOTS);
+    serr = seL4_Untyped_RetypeAtOffset(ut_cptr,
+                                       seL4_CapTableObject,
+                                       offset,
+                                       CSPACE_NODE_SIZE_IN_SLOTS_BITS,
+                                       c->root_cnode,
+                                       0, 
+                                       0,
+                                       l1,
+                                       1);
+    assert(serr == seL4_NoError);
 #ifdef CSPACE_DEBUG
-                printf("cspace: malloc bookkeeping for leaf node %d\n",i);
+    printf("cspace: added level 2 cnode @ index %d\n", l1);
 #endif
-                assert(c->level2_alloc_tables[i]);
-            }
-            c->level2_alloc_tables[i][j & (CSPACE_NODE_SIZE_IN_SLOTS -1)] = j+1; 
-            
+    return l1;
+}
+
+seL4_CPtr cspace_alloc_level2_slot(cspace_t *c)
+{
+    seL4_CPtr s;
+    int32_t l1;
+
+    if (c->num_free_slots <= 0) {
+        uint32_t *table;
+
+	/* allocate a new level 2 cnode here, so the cspace grows as it fills */        
+        table = cspace_malloc(sizeof(uint32_t)*CSPACE_NODE_SIZE_IN_SLOTS);
+        if (table == NULL) {
+            return CSPACE_NULL;
         }
-        c->level2_alloc_tables[i][j & (CSPACE_NODE_SIZE_IN_SLOTS -1)] = CSPACE_NULL; 
+        l1 = cspace_alloc_level2_node(c);
+        if (l1 == CSPACE_NOINDEX) {
+            cspace_free(table);
+            return CSPACE_NULL;
+        }
+        c->level2_alloc_tables[l1] = table;
+#ifdef CSPACE_DEBUG
+        printf("cspace: malloc bookkeeping for leaf node %d\n",l1);
+#endif
 
+        /*
+         * Rather than build a free list through the whole node now, hand its slots out in order.
+         * The free list only ever holds slots that have been given back.
+         */
+        c->next_level2_fresh_slot = l1 << CSPACE_NODE_SIZE_IN_SLOTS_BITS;
+        c->level2_fresh_end = (l1 + 1) << CSPACE_NODE_SIZE_IN_SLOTS_BITS;
         c->num_free_slots = CSPACE_NODE_SIZE_IN_SLOTS;
-        c->next_level2_free_slot = l1 << CSPACE_NODE_SIZE_IN_SLOTS_BITS;
         
 #ifdef CSPACE_DEBUG
     printf("cspace: free slots %d\n",  c->num_free_slots);
 #endif
 
     }
-    s = c->next_level2_free_slot;
-    c->next_level2_free_slot = c->level2_alloc_tables[s>>CSPACE_NODE_SIZE_IN_SLOTS_BITS]
-	[s & (CSPACE_NODE_SIZE_IN_SLOTS -1)];
+    if (c->next_level2_free_slot != CSPACE_NULL) {
+        s = c->next_level2_free_slot;
+        c->next_level2_free_slot = c->level2_alloc_tables[s>>CSPACE_NODE_SIZE_IN_SLOTS_BITS]
+            [s & (CSPACE_NODE_SIZE_IN_SLOTS -1)];
+    } else {
+        assert(c->next_level2_fresh_slot < c->level2_fresh_end);
+        s = c->next_level2_fresh_slot++;
+    }
     c->num_free_slots--;
     return s;
 }
 
+/*
+ * Find n free slots in a range node, aligned to n
+ * @pre n is a power of two
+ * @return the leaf offset of the first, or CSPACE_NOSLOT
+ */
+static int32_t cspace_range_find(struct cspace_range_node *node, int n)
+{
+    int nwords = CSPACE_NODE_SIZE_IN_SLOTS / 32;
+    int w, b;
+
+    if (n >= 32) {
+        /* Whole words */
+        for (w = 0; w < nwords; w += n / 32) {
+            for (b = 0; b < n / 32 && node->used[w + b] == 0; b++);
+            if (b == n / 32) {
+                return w * 32;
+            }
+        }
+    } else {
+        uint32_t mask = (1u << n) - 1;
+        for (w = 0; w < nwords; w++) {
+            if (node->used[w] == 0xffffffff) {
+                continue;
+            }
+            for (b = 0; b < 32; b += n) {
+                if ((node->used[w] & (mask << b)) == 0) {
+                    return w * 32 + b;
+                }
+            }
+        }
+    }
+    return CSPACE_NOSLOT;
+}
+
+seL4_CPtr cspace_alloc_level2_range(cspace_t *c, int n)
+{
+    struct cspace_range_node *node;
+    int32_t offset = CSPACE_NOSLOT;
+    int align;
+    int i;
+
+    assert(n > 0 && n <= CSPACE_NODE_SIZE_IN_SLOTS);
+    for (align = 1; align < n; align <<= 1);
+
+    for (node = c->range_nodes; node != NULL; node = node->next) {
+        offset = cspace_range_find(node, align);
+        if (offset != CSPACE_NOSLOT) {
+            break;
+        }
+    }
+    if (node == NULL) {
+        /* Add a node. Slot 0 of the cspace is never handed out */
+        node = cspace_malloc(sizeof(struct cspace_range_node));
+        if (node == NULL) {
+            return CSPACE_NULL;
+        }
+        node->l1index = cspace_alloc_level2_node(c);
+        if (node->l1index == CSPACE_NOINDEX) {
+            cspace_free(node);
+            return CSPACE_NULL;
+        }
+        for (i = 0; i < CSPACE_NODE_SIZE_IN_SLOTS / 32; i++) {
+            node->used[i] = 0;
+        }
+        node->next = c->range_nodes;
+        c->range_nodes = node;
+        offset = 0;
+    }
+
+    for (i = offset; i < offset + n; i++) {
+        node->used[i / 32] |= 1u << (i % 32);
+    }
+    return (node->l1index << CSPACE_NODE_SIZE_IN_SLOTS_BITS) + offset;
+}
+
 cspace_err_t cspace_free_level2_slot(cspace_t *c, seL4_CPtr s)
 {
     assert(s >= 0 && s < (CSPACE_NODE_SIZE_IN_SLOTS * CSPACE_NODE_SIZE_IN_SLOTS));
+    if (c->level2_alloc_tables[s>>CSPACE_NODE_SIZE_IN_SLOTS_BITS] == NULL) {
+        /* The slot was part of a range */
+        struct cspace_range_node *node = c->range_nodes;
+        int32_t offset = CSPACE_LEAF_OFFSET(s);
+
+        while (node != NULL && node->l1index != (s >> CSPACE_NODE_SIZE_IN_SLOTS_BITS)) {
+            node = node->next;
+        }
+        assert(node != NULL);
+        assert(node->used[offset / 32] & (1u << (offset % 32)));
+        node->used[offset / 32] &= ~(1u << (offset % 32));
+        return CSPACE_NOERROR;
+    }
     c->level2_alloc_tables[s>>CSPACE_NODE_SIZE_IN_SLOTS_BITS]
 	[s & (CSPACE_NODE_SIZE_IN_SLOTS -1)] = c->next_level2_free_slot;
  
@@ -23,6 +23,15 @@
 
 #define CSPACE_LEAF_OFFSET(x) (x & (CSPACE_NODE_SIZE_IN_SLOTS -1))
 
+/*
+ * A leaf cnode handed out in contiguous ranges, with a bit per slot in use
+ */
+struct cspace_range_node {
+    int32_t l1index;
+    uint32_t used[CSPACE_NODE_SIZE_IN_SLOTS / 32];
+    struct cspace_range_node *next;
+};
+
 extern cspace_ut_alloc_t cspace_ut_alloc; 
 extern cspace_ut_free_t cspace_ut_free; 
 extern cspace_ut_translate_t cspace_ut_translate; 
@@ -30,7 +39,9 @@ extern cspace_malloc_t cspace_malloc;
 extern cspace_free_t cspace_free;
 
 int32_t cspace_alloc_level1_index(cspace_t *c);
+int32_t cspace_alloc_level2_node(cspace_t *c);
 seL4_CPtr cspace_alloc_level2_slot(cspace_t *c);
+seL4_CPtr cspace_alloc_level2_range(cspace_t *c, int n);
 cspace_err_t cspace_free_slot(cspace_t *c, seL4_CPtr slot);
 cspace_err_t cspace_free_level1_index(cspace_t *c, int32_t s);
 cspace_err_t cspace_free_level2_slot(cspace_t *c, seL4_CPtr s);
@@ -17,14 +17,25 @@
 #include <stdint.h>
 #include <sel4/sel4.h>
 
+#include <autoconf.h>
+
 /* System calls for SOS */
 
 /* Endpoint for talking to SOS */
 #define SOS_IPC_EP_CAP     (0x1)
 #define TIMER_IPC_EP_CAP   (0x2)
 
+/* Virtual memory reserved for the process heap. SOS faults in pages on
+ * demand anywhere in this range */
+#define PROCESS_HEAP_START 0x20000000
+#define PROCESS_HEAP_END   0x30000000
+
 /* Limits */
+#ifdef CONFIG_SOS_MAX_FILES
+#define PROCESS_MAX_FILES CONFIG_SOS_MAX_FILES
+#else
 #define PROCESS_MAX_FILES 16
+#endif
 #define MAX_IO_BUF 0x1000
 #define N_NAME 32
 
@@ -86,6 +97,18 @@ int sos_sys_write(int file, const char *buf, size_t nbyte);
  * Returns -1 on error (invalid file).
  */
 
+struct iovec;
+
+int sos_sys_readv(int file, const struct iovec *iov, int iovcnt);
+/* Read from an open file into each buffer of "iov" in turn, as a single
+ * read of their total length. Returns as for sos_sys_read.
+ */
+
+int sos_sys_writev(int file, const struct iovec *iov, int iovcnt);
+/* Write the buffers of "iov" to an open file, as a single write of
+ * their total length. Returns as for sos_sys_write.
+ */
+
 int sos_getdirent(int pos, char *name, size_t nbyte);
 /* Reads name of entry "pos" in directory into "name", max "nbyte" bytes.
  * Returns number of bytes returned, zero if "pos" is next free entry,
@@ -103,6 +126,19 @@ pid_t sos_process_create(const char *path);
  * file).
  */
 
+pid_t sos_process_create_prio(const char *path, int prio);
+/* As sos_process_create, with the new process at priority "prio", from 0
+ * to 127. Returns -1 if prio is out of range. Processes started without
+ * one get 64. SOS serves higher priority processes first.
+ */
+
+pid_t sos_process_clone(void);
+/* Create a copy of the calling process. Memory is shared copy-on-write,
+ * so the copy is cheap however much state the caller has built up.
+ * Returns ID of new process to the caller, 0 to the new process, and
+ * -1 if error.
+ */
+
 int sos_process_delete(pid_t pid);
 /* Delete process (and close all its file descriptors).
  * Returns 0 if successful, -1 otherwise (invalid process).
@@ -149,4 +185,46 @@ int sos_share_vm(void *adr, size_t size, int writable);
  * Returns 0 if successful, -1 otherwise (invalid address or size).
  */
 
+/* Batched I/O through a submission ring shared with SOS. Operations are
+ * queued locally and started together by a single sos_ring_enter, so a
+ * program making many small writes pays for one round trip per batch.
+ */
+
+int sos_ring_setup(void);
+/* Map the submission ring. Must be called before any other sos_ring
+ * function. Returns 0 if successful, -1 otherwise.
+ */
+
+int sos_ring_queue(int op, int file, const void *buf, size_t nbyte);
+/* Queue an operation, one of SOS_RING_OP_READ or SOS_RING_OP_WRITE from
+ * sos_syscall.h. Data to be written is copied into the ring straight
+ * away; room is set aside for data to be read.
+ * Returns a handle for the operation, or -1 if the ring is full, in which
+ * case call sos_ring_enter with "wait" set and try again.
+ */
+
+int sos_ring_enter(int wait);
+/* Start every queued operation. If "wait" is non-zero, return only once
+ * all of them have completed. Their space in the ring is then reused, so
+ * collect their results before queuing more.
+ * Returns the number of operations started, -1 if error.
+ */
+
+int sos_ring_done(int handle);
+/* Returns non-zero once the operation "handle" has completed. */
+
+int sos_ring_result(int handle, void *buf);
+/* Returns the result of the completed operation "handle", as the
+ * equivalent system call would have. For reads the data is copied to
+ * "buf".
+ */
+
+struct sos_perf;
+
+int sos_perf_read(struct sos_perf *perf, int clear);
+/* Copy SOS's latency statistics, laid out as in sos_syscall.h, into
+ * "perf". If "clear" is non-zero SOS starts collecting them afresh.
+ * Returns 0 if successful, -1 otherwise.
+ */
+
 #endif
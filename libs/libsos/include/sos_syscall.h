@@ -0,0 +1,155 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* System call interface shared between libsos and SOS.
+ * This header must not depend on libc types so that SOS can include it. */
+
+#ifndef _SOS_SYSCALL_H
+#define _SOS_SYSCALL_H
+
+/*
+ * Message format: MR0 holds the syscall number, arguments follow in
+ * MR1 onwards. Replies carry the return value in MR0.
+ *
+ * Syscall 1 is deliberately left unimplemented; tty_test makes it to
+ * block forever.
+ */
+#define SOS_SYSCALL_NULL            0
+#define SOS_SYSCALL_PROCESS_CREATE  2
+#define SOS_SYSCALL_PROCESS_CLONE   3
+#define SOS_SYSCALL_OPEN            4
+#define SOS_SYSCALL_CLOSE           5
+#define SOS_SYSCALL_READ            6
+#define SOS_SYSCALL_WRITE           7
+#define SOS_SYSCALL_RING_SETUP      8
+#define SOS_SYSCALL_RING_ENTER      9
+#define SOS_SYSCALL_PERF            10
+
+/* Process priorities. PROCESS_CREATE takes the new process's priority
+ * in MR1, failing if it is out of range, and its path from MR2. A clone
+ * has its parent's priority. SOS serves the work of higher priority
+ * processes first. */
+#define SOS_PRIO_MIN                0
+#define SOS_PRIO_DEFAULT            64
+#define SOS_PRIO_MAX                127
+
+/* Open modes, the same values as the POSIX O_ flags. Open takes the mode
+ * in MR1 and the path from MR2; read and write take the file descriptor,
+ * an offset into the I/O buffer and a length in MR1 to MR3. */
+#define SOS_O_RDONLY                0
+#define SOS_O_WRONLY                1
+#define SOS_O_RDWR                  2
+#define SOS_O_ACCMODE               3
+
+/* Every process has a page shared with SOS at this address, through
+ * which read and write move their data */
+#define SOS_IO_BUFFER               0xA0001000
+#define SOS_IO_BUFFER_SIZE          0x1000
+
+/*
+ * Optional submission ring, mapped at SOS_RING_BUFFER by RING_SETUP.
+ * The process fills entries at tail and advances it, then makes one
+ * RING_ENTER call for the whole batch. SOS takes entries from head,
+ * advancing it, and sets each entry's result and then done once the
+ * operation completes, which may be after RING_ENTER has returned. If
+ * MR1 of RING_ENTER is non zero, the call also waits until every entry
+ * taken has completed. RING_ENTER returns the number of entries taken.
+ * An entry may be reused once it is done. Data for each entry lives in
+ * the rest of the ring page, from SOS_RING_DATA onwards.
+ */
+#define SOS_RING_BUFFER             0xA0002000
+#define SOS_RING_SIZE               0x1000
+#define SOS_RING_ENTRIES            32
+
+#define SOS_RING_OP_NOP             0
+#define SOS_RING_OP_READ            1
+#define SOS_RING_OP_WRITE           2
+
+struct sos_ring_entry {
+    int op;
+    int fd;
+    unsigned int data;          /* offset of the data in the ring page */
+    unsigned int nbyte;
+    volatile int result;
+    volatile int done;
+};
+
+struct sos_ring {
+    volatile unsigned int head; /* advanced by SOS */
+    volatile unsigned int tail; /* advanced by the process */
+    struct sos_ring_entry entries[SOS_RING_ENTRIES];
+};
+
+#define SOS_RING_DATA               sizeof(struct sos_ring)
+
+/*
+ * Every process has a read only view of the system clock, so that time
+ * stamps need no system call. SOS_CLOCK_PAGE holds the calibration below
+ * and SOS_CLOCK_COUNTER is the timer's register page. The counter is
+ * 32 bits and free running; epoch counts its wraps. While a wrap has not
+ * yet been seen by SOS, status_wrap is set in the status register.
+ *
+ * SOS makes seq odd while it updates the page. A reader takes seq, then
+ * epoch, the counter and the status register, and starts again if seq
+ * was odd or has changed. Microseconds since boot are then
+ * ((epoch << 32) + counter - base) / freq, with one more wrap added if
+ * status_wrap was set and the counter is in the bottom half of its range.
+ */
+#define SOS_CLOCK_PAGE              0xA0003000
+#define SOS_CLOCK_COUNTER           0xA0004000
+
+struct sos_clock {
+    volatile unsigned int seq;
+    volatile unsigned int epoch;
+    unsigned int base;          /* counter value at boot */
+    unsigned int freq;          /* counter ticks per microsecond */
+    unsigned int counter;       /* offsets into the register page */
+    unsigned int status;
+    unsigned int status_wrap;
+};
+
+/*
+ * Latency statistics, copied by PERF into the caller's I/O buffer. If
+ * MR1 is non zero they are then cleared. PERF returns the size copied.
+ *
+ * SOS times every system call from its arrival to its reply, every page
+ * fault until the thread is restarted, and every interrupt. Each kind has
+ * a histogram: system calls by number, then faults and interrupts. Bucket
+ * 0 counts times under a microsecond and bucket b those from 2^(b-1) up
+ * to 2^b; the last bucket also counts anything longer. The most recent
+ * events are kept in a ring, the next to be overwritten being at
+ * nevents % SOS_PERF_EVENTS.
+ */
+#define SOS_PERF_SYSCALLS           16
+#define SOS_PERF_VM_FAULT           (SOS_PERF_SYSCALLS)
+#define SOS_PERF_IRQ                (SOS_PERF_SYSCALLS + 1)
+#define SOS_PERF_KINDS              (SOS_PERF_SYSCALLS + 2)
+#define SOS_PERF_BUCKETS            24
+#define SOS_PERF_EVENTS             64
+
+struct sos_perf_event {
+    unsigned short kind;
+    unsigned short pid;         /* 0 for interrupts */
+    unsigned int start;         /* microseconds since boot, truncated */
+    unsigned int usecs;
+};
+
+struct sos_perf {
+    unsigned int hist[SOS_PERF_KINDS][SOS_PERF_BUCKETS];
+    unsigned int nevents;       /* recorded since last cleared */
+    struct sos_perf_event events[SOS_PERF_EVENTS];
+};
+
+/* Longest path that may be passed to SOS, including the terminator.
+ * Paths are sent in message registers: one holds the length and the
+ * characters are packed into those that follow. */
+#define SOS_PATH_MAX                256
+
+#endif
@@ -13,30 +13,242 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sos.h>
+#include <sos_syscall.h>
+#include <sys/uio.h>
 
 #include <sel4/sel4.h>
 
+/* Packs a string into the message registers starting at mr,
+ * preceded by its length. Returns the number of registers used. */
+static int sos_pack_path(int mr, const char *path) {
+    size_t len = strlen(path);
+    if (len >= SOS_PATH_MAX) {
+        return -1;
+    }
+    seL4_SetMR(mr, len);
+    memcpy(&seL4_GetIPCBuffer()->msg[mr + 1], path, len);
+    return 1 + (len + sizeof(seL4_Word) - 1) / sizeof(seL4_Word);
+}
+
 int sos_sys_open(const char *path, fmode_t mode) {
-    assert(!"You need to implement this");
-    return -1;
+    seL4_MessageInfo_t tag;
+    int nwords;
+
+    nwords = sos_pack_path(2, path);
+    if (nwords < 0) {
+        return -1;
+    }
+    seL4_SetMR(0, SOS_SYSCALL_OPEN);
+    seL4_SetMR(1, mode);
+    tag = seL4_MessageInfo_new(0, 0, 0, 2 + nwords);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    return (int)seL4_GetMR(0);
+}
+
+int sos_sys_close(int file) {
+    seL4_MessageInfo_t tag;
+
+    seL4_SetMR(0, SOS_SYSCALL_CLOSE);
+    seL4_SetMR(1, file);
+    tag = seL4_MessageInfo_new(0, 0, 0, 2);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    return (int)seL4_GetMR(0);
+}
+
+/* Read and write move data through the page shared with SOS */
+static char * const sos_io_buf = (char *)SOS_IO_BUFFER;
+
+static int sos_sys_io(seL4_Word syscall, int file, size_t nbyte) {
+    seL4_MessageInfo_t tag;
+
+    seL4_SetMR(0, syscall);
+    seL4_SetMR(1, file);
+    seL4_SetMR(2, 0);
+    seL4_SetMR(3, nbyte);
+    tag = seL4_MessageInfo_new(0, 0, 0, 4);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    return (int)seL4_GetMR(0);
+}
+
+/* A position within an iovec */
+struct sos_iov_pos {
+    int i;
+    size_t off;
+};
+
+/* Moves up to "max" bytes between an iovec, starting at "pos", and the
+ * I/O buffer, advancing "pos". Returns the number of bytes moved. */
+static size_t sos_iov_copy(const struct iovec *iov, int iovcnt,
+                           struct sos_iov_pos *pos, size_t max, int gather) {
+    size_t n = 0;
+
+    while (pos->i < iovcnt && n < max) {
+        char *base = (char *)iov[pos->i].iov_base + pos->off;
+        size_t len = iov[pos->i].iov_len - pos->off;
+
+        if (len > max - n) {
+            len = max - n;
+        }
+        if (gather) {
+            memcpy(sos_io_buf + n, base, len);
+        } else {
+            memcpy(base, sos_io_buf + n, len);
+        }
+        n += len;
+        pos->off += len;
+        if (pos->off == iov[pos->i].iov_len) {
+            pos->i++;
+            pos->off = 0;
+        }
+    }
+    return n;
+}
+
+/* Returns the number of bytes from "pos" to the end of an iovec, up to
+ * "max" */
+static size_t sos_iov_remaining(const struct iovec *iov, int iovcnt,
+                                const struct sos_iov_pos *pos, size_t max) {
+    size_t n = 0;
+    size_t off = pos->off;
+    int i;
+
+    for (i = pos->i; i < iovcnt && n < max; i++) {
+        size_t len = iov[i].iov_len - off;
+        n += (len > max - n) ? max - n : len;
+        off = 0;
+    }
+    return n;
+}
+
+int sos_sys_readv(int file, const struct iovec *iov, int iovcnt) {
+    struct sos_iov_pos pos = { 0, 0 };
+    size_t done = 0;
+
+    while (1) {
+        size_t n = sos_iov_remaining(iov, iovcnt, &pos, SOS_IO_BUFFER_SIZE);
+        int ret;
+
+        if (n == 0) {
+            break;
+        }
+        ret = sos_sys_io(SOS_SYSCALL_READ, file, n);
+        if (ret < 0) {
+            return (done > 0) ? (int)done : -1;
+        }
+        /* Scatter what arrived across the vector */
+        sos_iov_copy(iov, iovcnt, &pos, ret, 0);
+        done += ret;
+        if ((size_t)ret < n) {
+            /* End of file, or the end of a line from the console */
+            break;
+        }
+    }
+    return done;
+}
+
+int sos_sys_writev(int file, const struct iovec *iov, int iovcnt) {
+    struct sos_iov_pos pos = { 0, 0 };
+    size_t done = 0;
+
+    while (1) {
+        /* Gather as much of the vector as fits in the I/O buffer */
+        size_t n = sos_iov_copy(iov, iovcnt, &pos, SOS_IO_BUFFER_SIZE, 1);
+        int ret;
+
+        if (n == 0) {
+            break;
+        }
+        ret = sos_sys_io(SOS_SYSCALL_WRITE, file, n);
+        if (ret < 0) {
+            return (done > 0) ? (int)done : -1;
+        }
+        done += ret;
+        if ((size_t)ret < n) {
+            break;
+        }
+    }
+    return done;
 }
 
 int sos_sys_read(int file, char *buf, size_t nbyte) {
-    assert(!"You need to implement this");
-    return -1;
+    struct iovec iov = { .iov_base = buf, .iov_len = nbyte };
+    return sos_sys_readv(file, &iov, 1);
 }
 
 int sos_sys_write(int file, const char *buf, size_t nbyte) {
-    assert(!"You need to implement this");
-    return -1;
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = nbyte };
+    return sos_sys_writev(file, &iov, 1);
 }
 
 void sos_sys_usleep(int msec) {
     assert(!"You need to implement this");
 }
 
+/* Reads the clock SOS maps into every process, see sos_syscall.h */
 int64_t sos_sys_time_stamp(void) {
-    assert(!"You need to implement this");
-    return -1;
+    const struct sos_clock *clock = (const struct sos_clock *)SOS_CLOCK_PAGE;
+    const volatile char *regs = (const volatile char *)SOS_CLOCK_COUNTER;
+    unsigned int seq, epoch;
+    uint32_t count, status;
+    uint64_t ticks;
+
+    do {
+        seq = clock->seq;
+        __sync_synchronize();
+        epoch = clock->epoch;
+        count = *(const volatile uint32_t *)(regs + clock->counter);
+        status = *(const volatile uint32_t *)(regs + clock->status);
+        __sync_synchronize();
+    } while ((seq & 1) || seq != clock->seq);
+
+    ticks = ((uint64_t)epoch << 32) + count;
+    if ((status & clock->status_wrap) && count < (1u << 31)) {
+        /* The counter has wrapped but SOS has yet to see it */
+        ticks += (uint64_t)1 << 32;
+    }
+    return (ticks - clock->base) / clock->freq;
 }
 
+pid_t sos_process_create(const char *path) {
+    return sos_process_create_prio(path, SOS_PRIO_DEFAULT);
+}
+
+pid_t sos_process_create_prio(const char *path, int prio) {
+    seL4_MessageInfo_t tag;
+    int nwords;
+
+    nwords = sos_pack_path(2, path);
+    if (nwords < 0) {
+        return -1;
+    }
+    seL4_SetMR(0, SOS_SYSCALL_PROCESS_CREATE);
+    seL4_SetMR(1, prio);
+    tag = seL4_MessageInfo_new(0, 0, 0, 2 + nwords);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    return (pid_t)seL4_GetMR(0);
+}
+
+pid_t sos_process_clone(void) {
+    seL4_MessageInfo_t tag;
+
+    seL4_SetMR(0, SOS_SYSCALL_PROCESS_CLONE);
+    tag = seL4_MessageInfo_new(0, 0, 0, 1);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    return (pid_t)seL4_GetMR(0);
+}
+
+int sos_perf_read(struct sos_perf *perf, int clear) {
+    seL4_MessageInfo_t tag;
+    int n;
+
+    seL4_SetMR(0, SOS_SYSCALL_PERF);
+    seL4_SetMR(1, clear);
+    tag = seL4_MessageInfo_new(0, 0, 0, 2);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    n = (int)seL4_GetMR(0);
+    if (n != sizeof(*perf)) {
+        return -1;
+    }
+    memcpy(perf, sos_io_buf, n);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <sos.h>
+#include <sos_syscall.h>
+
+#include <sel4/sel4.h>
+
+static struct sos_ring * const ring = (struct sos_ring *)SOS_RING_BUFFER;
+
+/* Data for queued operations is packed into the ring page from here. It
+ * is only reclaimed once the ring has drained. */
+static unsigned int data_next = SOS_RING_DATA;
+
+int sos_ring_setup(void) {
+    seL4_MessageInfo_t tag;
+
+    seL4_SetMR(0, SOS_SYSCALL_RING_SETUP);
+    tag = seL4_MessageInfo_new(0, 0, 0, 1);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    return (int)seL4_GetMR(0);
+}
+
+int sos_ring_queue(int op, int file, const void *buf, size_t nbyte) {
+    unsigned int tail = ring->tail;
+    struct sos_ring_entry *e = &ring->entries[tail % SOS_RING_ENTRIES];
+
+    /* Entries start out zeroed, so only those already used once can be
+     * still in flight */
+    if (tail >= SOS_RING_ENTRIES && !e->done) {
+        return -1;
+    }
+    if (nbyte > SOS_RING_SIZE - data_next) {
+        return -1;
+    }
+
+    e->op = op;
+    e->fd = file;
+    e->data = data_next;
+    e->nbyte = nbyte;
+    e->done = 0;
+    if (op == SOS_RING_OP_WRITE) {
+        memcpy((char *)ring + data_next, buf, nbyte);
+    }
+    data_next += nbyte;
+    ring->tail = tail + 1;
+    return tail % SOS_RING_ENTRIES;
+}
+
+int sos_ring_enter(int wait) {
+    seL4_MessageInfo_t tag;
+    int taken;
+
+    seL4_SetMR(0, SOS_SYSCALL_RING_ENTER);
+    seL4_SetMR(1, wait);
+    tag = seL4_MessageInfo_new(0, 0, 0, 2);
+    seL4_Call(SOS_IPC_EP_CAP, tag);
+    taken = (int)seL4_GetMR(0);
+    if (wait && taken >= 0) {
+        /* Everything has completed, so the data area is free again */
+        data_next = SOS_RING_DATA;
+    }
+    return taken;
+}
+
+int sos_ring_done(int handle) {
+    return ring->entries[handle].done;
+}
+
+int sos_ring_result(int handle, void *buf) {
+    struct sos_ring_entry *e = &ring->entries[handle];
+
+    assert(e->done);
+    if (e->op == SOS_RING_OP_READ && e->result > 0) {
+        memcpy(buf, (char *)ring + e->data, e->result);
+    }
+    return e->result;
+}
@@ -16,18 +16,16 @@
 #include <errno.h>
 #include <assert.h>
 
+#include <sos.h>
+
 /*
- * Statically allocated morecore area.
- *
- * This is rather terrible, but is the simplest option without a
- * huge amount of infrastructure.
+ * The morecore area is the heap region that SOS sets up in every
+ * process. Pages are allocated by SOS when we first touch them.
  */
-#define MORECORE_AREA_BYTE_SIZE 0x100000
-char morecore_area[MORECORE_AREA_BYTE_SIZE];
 
 /* Pointer to free space in the morecore area. */
-static uintptr_t morecore_base = (uintptr_t) &morecore_area;
-static uintptr_t morecore_top = (uintptr_t) &morecore_area[MORECORE_AREA_BYTE_SIZE];
+static uintptr_t morecore_base = (uintptr_t) PROCESS_HEAP_START;
+static uintptr_t morecore_top = (uintptr_t) PROCESS_HEAP_END;
 
 /* Actual morecore implementation
    returns 0 if failure, returns newbrk if success.
@@ -43,7 +41,7 @@ sys_brk(va_list ap)
     /*if the newbrk is 0, return the bottom of the heap*/
     if (!newbrk) {
         ret = morecore_base;
-    } else if (newbrk < morecore_top && newbrk > (uintptr_t)&morecore_area[0]) {
+    } else if (newbrk < morecore_top && newbrk > (uintptr_t)PROCESS_HEAP_START) {
         ret = morecore_base = newbrk;
     } else {
         ret = 0;
@@ -34,6 +34,67 @@
 #define STDOUT_FD 1
 #define STDERR_FD 2
 
+/* Console output is gathered here so that each flush by stdio, which
+ * usually hands over two buffers, is a single sos_write */
+static char tty_buf[MAX_IO_BUF];
+
+/* Writes to the console until everything is written or a write makes no
+ * progress. Returns the number of bytes written. */
+static size_t
+tty_write(const char *data, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        size_t ret = sos_write((void *)(data + done), len - done);
+        if (ret == 0 || ret > len - done) {
+            break;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+/* Returns the number of bytes written, or -EIO if there were none */
+static long
+tty_writev(const struct iovec *iov, int iovcnt)
+{
+    size_t n = 0;
+    long ret = 0;
+
+    if (iovcnt == 1) {
+        ret = tty_write(iov[0].iov_base, iov[0].iov_len);
+        return (ret > 0) ? ret : -EIO;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        const char *data = iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+
+        while (len > 0) {
+            size_t count = sizeof(tty_buf) - n;
+            if (count > len) {
+                count = len;
+            }
+            memcpy(tty_buf + n, data, count);
+            n += count;
+            data += count;
+            len -= count;
+            if (n == sizeof(tty_buf)) {
+                size_t written = tty_write(tty_buf, n);
+                ret += written;
+                if (written < n) {
+                    return (ret > 0) ? ret : -EIO;
+                }
+                n = 0;
+            }
+        }
+    }
+    if (n > 0) {
+        ret += tty_write(tty_buf, n);
+    }
+    return (ret > 0) ? ret : -EIO;
+}
+
 long
 sys_writev(va_list ap)
 {
@@ -65,13 +126,9 @@ sys_writev(va_list ap)
 
     /* Write the buffer to console if the fd is for stdout or stderr. */
     if (fildes == STDOUT_FD || fildes == STDERR_FD) {
-        for (int i = 0; i < iovcnt; i++) {
-            ret += sos_write(iov[i].iov_base, iov[i].iov_len);
-        }
+        ret = tty_writev(iov, iovcnt);
     } else {
-        for (int i = 0; i < iovcnt; i++) {
-            ret += sos_sys_write(fildes, iov[i].iov_base, iov[i].iov_len);
-        }
+        ret = sos_sys_writev(fildes, iov, iovcnt);
     }
 
     return ret;
@@ -82,14 +139,11 @@ long sys_readv(va_list ap)
     int fd = va_arg(ap, int);
     struct iovec *iov = va_arg(ap, struct iovec*);
     int iovcnt = va_arg(ap, int);
-    int i;
-    long read;
 
-    read = 0;
-    for (i = 0; i < iovcnt; i++) {
-        read += sos_sys_read(fd, iov[i].iov_base, iov[i].iov_len);
+    if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+        return -EINVAL;
     }
-    return read;
+    return sos_sys_readv(fd, iov, iovcnt);
 }
 
 long sys_read(va_list ap)
@@ -165,10 +219,6 @@ sys_open(va_list ap)
 long
 sys_close(va_list ap)
 {
-    assert(!"Not implemented");
-    return 0;
-#if 0
     int fd = va_arg(ap, int);
     return sos_sys_close(fd);
-#endif
 }
@@ -0,0 +1 @@
+/* libutils wants the kernel configuration, of which nothing is needed here */
@@ -0,0 +1,25 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/* Just enough of libsel4 for the untyped allocator to build on the host */
+#ifndef _UTBENCH_SEL4_H_
+#define _UTBENCH_SEL4_H_
+
+#include <stdint.h>
+
+typedef uint32_t seL4_Word;
+typedef seL4_Word seL4_Untyped;
+typedef struct seL4_BootInfo seL4_BootInfo;
+
+#define seL4_EndpointBits   4
+#define seL4_PageBits       12
+#define seL4_PageDirBits    14
+
+#endif /* _UTBENCH_SEL4_H_ */
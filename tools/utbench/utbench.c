@@ -0,0 +1,163 @@
+/*
+ * Copyright 2014, NICTA
+ *
+ * This software may be distributed and modified according to the terms of
+ * the BSD 2-Clause license. Note that NO WARRANTY is provided.
+ * See "LICENSE_BSD2.txt" for details.
+ *
+ * @TAG(NICTA_BSD)
+ */
+
+/*
+ * Times ut_alloc and ut_free on the host. The allocator manages a single
+ * 1 GiB untyped object and is driven the way SOS drives it: frames are
+ * taken until memory is nearly full, frames are recycled while it stays
+ * nearly full, and objects of every size SOS asks for come and go at
+ * random. Only sizes the earlier bitfield allocators supported are used,
+ * and memory is never exhausted (the original bitfield reads out of
+ * bounds once it is), so that they can be built with UT_SRCS and
+ * compared (see the Makefile).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <utils/util.h>
+
+#include "ut.h"
+
+#define UT_LOW          0x40000000u
+#define UT_HIGH         0x80000000u
+#define UT_BITS         30
+#define NFRAMES         ((UT_HIGH - UT_LOW) >> seL4_PageBits)
+
+/* Frames left free while recycling, and recycle rounds */
+#define RECYCLE_FREE    64
+#define RECYCLE_ROUNDS  1000000
+
+/* Objects live at once and operations in the mixed run */
+#define MIXED_LIVE      50000
+#define MIXED_OPS       2000000
+
+/* TCBs, endpoints, page tables, frames and page directories */
+static const int _mixed_sizes[] = {4, 9, 10, 12, 14};
+
+static seL4_Word _frames[NFRAMES];
+
+static struct {
+    seL4_Word addr;
+    int sizebits;
+} _live[MIXED_LIVE];
+
+/*
+ * What the allocator expects of the rest of SOS
+ */
+int
+ut_size_bits(seL4_Word addr){
+    return (addr >= UT_LOW && addr < UT_HIGH) ? UT_BITS : -1;
+}
+
+void
+plogf(const char* msg, ...){
+    va_list ap;
+    va_start(ap, msg);
+    vfprintf(stderr, msg, ap);
+    va_end(ap);
+}
+
+void
+__conditional_panic(int condition, const char* message, const char* file,
+                    const char* func, int line){
+    if(condition){
+        fprintf(stderr, "utbench: %s at %s:%d (%s)\n", message, file, line,
+                func);
+        abort();
+    }
+}
+
+static double
+_now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Allocations that failed although there was memory to satisfy them */
+static int _failed;
+
+static void
+_report(const char* name, int ops, double start){
+    printf("%-32s %10d ops %8.1f ns/op", name, ops, (_now() - start) / ops);
+    if(_failed){
+        printf(" (%d allocations failed)", _failed);
+    }
+    printf("\n");
+    _failed = 0;
+}
+
+int
+main(void){
+    int nframes;
+    int nlive;
+    double start;
+    int i;
+
+    srand(1);
+    ut_allocator_init(UT_LOW, UT_HIGH);
+
+    /* Frames until memory is nearly full */
+    start = _now();
+    for(nframes = 0; nframes < NFRAMES - RECYCLE_FREE; nframes++){
+        _frames[nframes] = ut_alloc(seL4_PageBits);
+        if(_frames[nframes] == 0){
+            _failed++;
+            break;
+        }
+    }
+    _report("alloc frames until nearly full", nframes, start);
+
+    /* Recycle frames while nearly full. Each round frees a random frame
+     * and takes one back */
+    start = _now();
+    for(i = 0; i < RECYCLE_ROUNDS; i++){
+        int j = rand() % nframes;
+        ut_free(_frames[j], seL4_PageBits);
+        _frames[j] = ut_alloc(seL4_PageBits);
+        if(_frames[j] == 0){
+            _failed++;
+            _frames[j] = _frames[--nframes];
+        }
+    }
+    _report("free/alloc frame, nearly full", RECYCLE_ROUNDS, start);
+
+    /* Hand everything back */
+    start = _now();
+    for(i = 0; i < nframes; i++){
+        ut_free(_frames[i], seL4_PageBits);
+    }
+    _report("free frames until empty", nframes, start);
+
+    /* Objects of mixed sizes coming and going at random */
+    nlive = 0;
+    start = _now();
+    for(i = 0; i < MIXED_OPS; i++){
+        if(nlive < MIXED_LIVE && (nlive == 0 || rand() % 2)){
+            int sizebits = _mixed_sizes[rand() % ARRAY_SIZE(_mixed_sizes)];
+            _live[nlive].addr = ut_alloc(sizebits);
+            _live[nlive].sizebits = sizebits;
+            if(_live[nlive].addr == 0){
+                _failed++;
+            }else{
+                nlive++;
+            }
+        }else{
+            int j = rand() % nlive;
+            ut_free(_live[j].addr, _live[j].sizebits);
+            _live[j] = _live[--nlive];
+        }
+    }
+    _report("mixed sizes at random", MIXED_OPS, start);
+
+    return 0;
+}